@@ -0,0 +1,212 @@
+
+// Multithreaded microbenchmark of XrdAccSciTokens::Access on the cache-hit
+// path.  A synthetic population of tokens is minted with a local key, each is
+// validated once to warm the cache, and then an increasing number of threads
+// replay random tokens against the plugin; lookups/sec is reported for each
+// thread count.  Before timing, it checks that a cache hit allocates no heap
+// memory, whether through operator new or the C allocator (as libcrypto
+// does), and fails if one does.
+//
+// Usage: scitokens-access-bench [-t max_threads] [-n tokens] [-s seconds]
+
+#include "XrdAcc/XrdAccAuthorize.hh"
+#include "XrdOuc/XrdOucEnv.hh"
+#include "XrdSec/XrdSecEntity.hh"
+#include "XrdSys/XrdSysLogger.hh"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "bench_tokens.hh"
+
+extern "C" XrdAccAuthorize *XrdAccAuthorizeObject(XrdSysLogger *lp, const char *cfn, const char *parm);
+
+namespace {
+
+const char g_issuer[] = "https://bench.scitokens.org";
+
+// Heap allocations made by this thread while counting is enabled.
+thread_local bool g_count_allocations = false;
+thread_local uint64_t g_allocations = 0;
+
+}
+
+// The C allocator is replaced so that allocations made inside libcrypto and
+// other C libraries are counted along with those of operator new, which
+// calls malloc().  The replacements forward to glibc's own implementations.
+extern "C" {
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+
+void *malloc(size_t size)
+{
+    if (g_count_allocations) {g_allocations++;}
+    return __libc_malloc(size);
+}
+
+
+void *calloc(size_t count, size_t size)
+{
+    if (g_count_allocations) {g_allocations++;}
+    return __libc_calloc(count, size);
+}
+
+
+void *realloc(void *ptr, size_t size)
+{
+    if (g_count_allocations) {g_allocations++;}
+    return __libc_realloc(ptr, size);
+}
+
+
+void *memalign(size_t alignment, size_t size)
+{
+    if (g_count_allocations) {g_allocations++;}
+    return __libc_memalign(alignment, size);
+}
+
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+
+int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+    if (alignment % sizeof(void *) || (alignment & (alignment - 1))) {return EINVAL;}
+    void *result = memalign(alignment, size);
+    if (!result) {return ENOMEM;}
+    *ptr = result;
+    return 0;
+}
+
+}
+
+
+int main(int argc, char *argv[])
+{
+    unsigned max_threads = std::thread::hardware_concurrency();
+    unsigned token_count = 1000;
+    double seconds = 2.0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:n:s:")) != -1) {
+        switch (opt) {
+        case 't': max_threads = atoi(optarg); break;
+        case 'n': token_count = atoi(optarg); break;
+        case 's': seconds = atof(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-t max_threads] [-n tokens] [-s seconds]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (!max_threads) {max_threads = 1;}
+    if (!token_count) {token_count = 1;}
+
+    std::vector<std::unique_ptr<XrdOucEnv>> envs;
+    std::unique_ptr<XrdAccAuthorize> authz;
+    XrdSysLogger logger;
+    try {
+        auto key = bench::generate_key("bench");
+        bench::publish_key(g_issuer, key);
+        bench::TokenMinter minter(g_issuer, key);
+        envs.reserve(token_count);
+        for (unsigned idx = 0; idx < token_count; idx++) {
+            auto token = minter.mint("user" + std::to_string(idx),
+                "read:/user" + std::to_string(idx) + " write:/user" + std::to_string(idx) + "/out", 3600);
+            auto cgi = "authz=Bearer%20" + token;
+            envs.emplace_back(new XrdOucEnv(cgi.c_str()));
+        }
+        auto parms = "config=" + bench::write_config(g_issuer, "/bench");
+        authz.reset(XrdAccAuthorizeObject(&logger, nullptr, parms.c_str()));
+    } catch (std::exception &exc) {
+        fprintf(stderr, "Benchmark setup failed: %s\n", exc.what());
+        return 1;
+    }
+    if (!authz) {
+        fprintf(stderr, "Failed to load the SciTokens authorization plugin\n");
+        return 1;
+    }
+
+    std::vector<std::string> paths;
+    paths.reserve(token_count);
+    for (unsigned idx = 0; idx < token_count; idx++) {
+        paths.push_back("/bench/user" + std::to_string(idx) + "/file.dat");
+        XrdSecEntity entity("https");
+        if (authz->Access(&entity, paths.back().c_str(), AOP_Read, envs[idx].get()) == XrdAccPriv_None) {
+            fprintf(stderr, "Token %u was not authorized during warm-up\n", idx);
+            return 1;
+        }
+        free(entity.name);
+    }
+
+    {
+        // Every token is cached now and the entity already carries a name,
+        // so Access() must not touch the heap.
+        XrdSecEntity entity("https");
+        entity.name = strdup("bench");
+        g_allocations = 0;
+        g_count_allocations = true;
+        for (unsigned idx = 0; idx < token_count; idx++) {
+            authz->Access(&entity, paths[idx].c_str(), AOP_Read, envs[idx].get());
+        }
+        g_count_allocations = false;
+        free(entity.name);
+        printf("allocations per cache hit: %.3f\n", static_cast<double>(g_allocations) / token_count);
+        if (g_allocations) {
+            fprintf(stderr, "The cache-hit path allocated %llu times\n",
+                static_cast<unsigned long long>(g_allocations));
+            return 1;
+        }
+    }
+
+    std::vector<unsigned> thread_counts;
+    for (unsigned threads = 1; threads < max_threads; threads *= 2) {
+        thread_counts.push_back(threads);
+    }
+    thread_counts.push_back(max_threads);
+
+    printf("%8s %16s\n", "threads", "lookups/sec");
+    for (auto threads : thread_counts) {
+        std::atomic<bool> stop(false);
+        std::atomic<uint64_t> total(0);
+        std::vector<std::thread> workers;
+        for (unsigned tid = 0; tid < threads; tid++) {
+            workers.emplace_back([&, tid]() {
+                std::minstd_rand rng(tid + 1);
+                XrdSecEntity entity("https");
+                entity.name = strdup("bench");
+                uint64_t count = 0;
+                while (!stop.load(std::memory_order_relaxed)) {
+                    for (int iter = 0; iter < 64; iter++) {
+                        auto idx = rng() % token_count;
+                        authz->Access(&entity, paths[idx].c_str(), AOP_Read, envs[idx].get());
+                    }
+                    count += 64;
+                }
+                free(entity.name);
+                total += count;
+            });
+        }
+        auto start = std::chrono::steady_clock::now();
+        std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+        stop = true;
+        for (auto &worker : workers) {worker.join();}
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        printf("%8u %16.0f\n", threads, total.load() / elapsed.count());
+    }
+    return 0;
+}
@@ -0,0 +1,202 @@
+#ifndef __BENCH_TOKENS_HH
+#define __BENCH_TOKENS_HH
+
+// Helpers shared by the benchmark programs: generate a local signing key,
+// register its public half with the scitokens-cpp key cache (so no issuer
+// needs to be reachable over the network) and mint tokens with it.
+
+#include <openssl/bio.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+#include <stdlib.h>
+
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "scitokens/scitokens.h"
+
+namespace bench {
+
+inline std::string base64url(const unsigned char *data, size_t len)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+    std::string result;
+    result.reserve((len * 4 + 2) / 3);
+    size_t idx = 0;
+    for (; idx + 2 < len; idx += 3) {
+        unsigned val = (data[idx] << 16) | (data[idx + 1] << 8) | data[idx + 2];
+        result.push_back(alphabet[(val >> 18) & 0x3f]);
+        result.push_back(alphabet[(val >> 12) & 0x3f]);
+        result.push_back(alphabet[(val >> 6) & 0x3f]);
+        result.push_back(alphabet[val & 0x3f]);
+    }
+    if (idx + 1 == len) {
+        unsigned val = data[idx] << 16;
+        result.push_back(alphabet[(val >> 18) & 0x3f]);
+        result.push_back(alphabet[(val >> 12) & 0x3f]);
+    } else if (idx + 2 == len) {
+        unsigned val = (data[idx] << 16) | (data[idx + 1] << 8);
+        result.push_back(alphabet[(val >> 18) & 0x3f]);
+        result.push_back(alphabet[(val >> 12) & 0x3f]);
+        result.push_back(alphabet[(val >> 6) & 0x3f]);
+    }
+    return result;
+}
+
+inline std::string bio_to_string(BIO *bio)
+{
+    char *data = nullptr;
+    long len = BIO_get_mem_data(bio, &data);
+    return std::string(data, len);
+}
+
+// An ES256 key pair and the JWKS document advertising its public half.
+struct SigningKey
+{
+    std::string m_kid;
+    std::string m_private_pem;
+    std::string m_public_pem;
+    std::string m_jwks;
+};
+
+inline SigningKey generate_key(const std::string &kid)
+{
+    SigningKey key;
+    key.m_kid = kid;
+
+    EVP_PKEY *pkey = nullptr;
+    EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+    if (!ctx || EVP_PKEY_keygen_init(ctx) <= 0 ||
+        EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx, NID_X9_62_prime256v1) <= 0 ||
+        EVP_PKEY_keygen(ctx, &pkey) <= 0)
+    {
+        EVP_PKEY_CTX_free(ctx);
+        throw std::runtime_error("Failed to generate EC key");
+    }
+    EVP_PKEY_CTX_free(ctx);
+
+    BIO *priv = BIO_new(BIO_s_mem());
+    BIO *pub = BIO_new(BIO_s_mem());
+    PEM_write_bio_PrivateKey(priv, pkey, nullptr, nullptr, 0, nullptr, nullptr);
+    PEM_write_bio_PUBKEY(pub, pkey);
+    key.m_private_pem = bio_to_string(priv);
+    key.m_public_pem = bio_to_string(pub);
+    BIO_free(priv);
+    BIO_free(pub);
+
+    // The DER-encoded SubjectPublicKeyInfo of a P-256 key ends with the
+    // uncompressed point: 0x04 || X (32 bytes) || Y (32 bytes).
+    int der_len = i2d_PUBKEY(pkey, nullptr);
+    std::vector<unsigned char> der(der_len > 0 ? der_len : 0);
+    unsigned char *der_ptr = der.data();
+    i2d_PUBKEY(pkey, &der_ptr);
+    EVP_PKEY_free(pkey);
+    if (der.size() < 65 || der[der.size() - 65] != 0x04) {
+        throw std::runtime_error("Unexpected EC public key encoding");
+    }
+    const unsigned char *point = &der[der.size() - 64];
+    key.m_jwks = "{\"keys\": [{\"alg\": \"ES256\", \"kty\": \"EC\", \"crv\": \"P-256\", \"use\": \"sig\", "
+        "\"kid\": \"" + kid + "\", \"x\": \"" + base64url(point, 32) + "\", \"y\": \"" +
+        base64url(point + 32, 32) + "\"}]}";
+    return key;
+}
+
+// Make `key` the trusted key for `issuer` in the local scitokens-cpp key cache.
+inline void publish_key(const std::string &issuer, const SigningKey &key)
+{
+    char *err_msg = nullptr;
+    if (keycache_set_jwks(issuer.c_str(), key.m_jwks.c_str(), &err_msg)) {
+        std::string msg = std::string("Failed to store JWKS: ") + (err_msg ? err_msg : "unknown error");
+        free(err_msg);
+        throw std::runtime_error(msg);
+    }
+}
+
+// Write a plugin configuration trusting `issuer` for `base_path` into a fresh
+// temporary directory and return its path.  Each of `global_options` is a
+// "key = value" line for the [Global] section.
+inline std::string write_config(const std::string &issuer, const std::string &base_path,
+                                const std::vector<std::string> &global_options = {})
+{
+    char dir_template[] = "/tmp/scitokens-bench.XXXXXX";
+    if (!mkdtemp(dir_template)) {
+        throw std::runtime_error("Failed to create temporary directory");
+    }
+    std::string cfg_file = std::string(dir_template) + "/scitokens.cfg";
+    std::ofstream cfg(cfg_file);
+    if (!global_options.empty()) {
+        cfg << "[Global]\n";
+        for (const auto &option : global_options) {
+            cfg << option << "\n";
+        }
+    }
+    cfg << "[Issuer Bench]\n"
+        << "issuer = " << issuer << "\n"
+        << "base_path = " << base_path << "\n";
+    if (!cfg) {
+        throw std::runtime_error("Failed to write " + cfg_file);
+    }
+    return cfg_file;
+}
+
+class TokenMinter
+{
+public:
+    TokenMinter(const std::string &issuer, const SigningKey &key)
+        : m_issuer(issuer)
+    {
+        char *err_msg = nullptr;
+        m_key = scitoken_key_create(key.m_kid.c_str(), "ES256", key.m_public_pem.c_str(),
+            key.m_private_pem.c_str(), &err_msg);
+        if (!m_key) {
+            std::string msg = std::string("Failed to create signing key: ") + (err_msg ? err_msg : "unknown error");
+            free(err_msg);
+            throw std::runtime_error(msg);
+        }
+    }
+
+    ~TokenMinter() {scitoken_key_destroy(m_key);}
+
+    TokenMinter(const TokenMinter &) = delete;
+    TokenMinter &operator=(const TokenMinter &) = delete;
+
+    // Returns the serialized token, ready to be prefixed with "Bearer%20".
+    std::string mint(const std::string &subject, const std::string &scope, int lifetime) const
+    {
+        char *err_msg = nullptr;
+        SciToken token = scitoken_create(m_key);
+        if (scitoken_set_claim_string(token, "iss", m_issuer.c_str(), &err_msg) ||
+            scitoken_set_claim_string(token, "sub", subject.c_str(), &err_msg) ||
+            scitoken_set_claim_string(token, "scope", scope.c_str(), &err_msg))
+        {
+            scitoken_destroy(token);
+            std::string msg = std::string("Failed to set token claim: ") + (err_msg ? err_msg : "unknown error");
+            free(err_msg);
+            throw std::runtime_error(msg);
+        }
+        scitoken_set_lifetime(token, lifetime);
+        char *value = nullptr;
+        if (scitoken_serialize(token, &value, &err_msg)) {
+            scitoken_destroy(token);
+            std::string msg = std::string("Failed to serialize token: ") + (err_msg ? err_msg : "unknown error");
+            free(err_msg);
+            throw std::runtime_error(msg);
+        }
+        std::string result(value);
+        free(value);
+        scitoken_destroy(token);
+        return result;
+    }
+
+private:
+    const std::string m_issuer;
+    SciTokenKey m_key{nullptr};
+};
+
+}
+
+#endif
@@ -0,0 +1,236 @@
+// Time loading and reloading synthetic configurations with many issuers, and
+// mapping token ACLs against long restricted_path lists.
+//
+// For each issuer count, a configuration file is generated and loaded from
+// scratch, reloaded unchanged and reloaded with one section edited; the
+// reloads must recompile no section and exactly one section respectively.
+// For each restricted_path length, random ACLs are mapped by
+// IssuerConfig::map_acl() and by the linear scan it replaced, which must
+// produce the same rules, and both are timed.
+//
+// Usage: scitokens-config-bench [-a acls] [-r restricted_paths_per_issuer]
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "INIReader.h"
+
+#include "scitokens_config.hh"
+
+using scitokens_xrootd::ConfigSnapshot;
+using scitokens_xrootd::IssuerConfig;
+using scitokens_xrootd::IssuerSection;
+
+namespace {
+
+double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+std::string restricted_paths(size_t issuer, size_t count, const char *suffix)
+{
+    std::string result;
+    for (size_t idx = 0; idx < count; idx++) {
+        // One per line, as INIReader limits the length of a line.
+        result += "\n    /data/" + std::to_string(issuer) + "/project" + std::to_string(idx) + suffix;
+    }
+    return result;
+}
+
+void write_config(const std::string &path, size_t issuers, size_t restricted, size_t edited)
+{
+    std::ofstream out(path);
+    out << "[Global]\naudience = https://xrootd.example.org\n\n";
+    for (size_t idx = 0; idx < issuers; idx++) {
+        out << "[Issuer tenant" << idx << "]\n"
+            << "issuer = https://tenant" << idx << ".example.org/oauth2\n"
+            << "base_path = /vo/" << idx << ", /vo/" << idx << "/scratch\n"
+            << "restricted_path =" << restricted_paths(idx, restricted, idx == edited ? "/new" : "") << "\n"
+            << "map_subject = " << (idx % 2 ? "true" : "false") << "\n"
+            << "default_user = user" << idx << "\n\n";
+    }
+}
+
+// The part of the plugin's ParseConfig() that reads the issuer sections.
+bool load(const std::string &path, const ConfigSnapshot *previous, std::unique_ptr<ConfigSnapshot> &result)
+{
+    INIReader reader(path);
+    if (reader.ParseError()) {return false;}
+    std::vector<IssuerSection> sections;
+    for (const auto &section : reader.Sections()) {
+        if (section.compare(0, 7, "Issuer ")) {continue;}
+        IssuerSection issuer_section;
+        std::string err;
+        if (scitokens_xrootd::ReadIssuerSection(reader, section, issuer_section, err)) {
+            sections.push_back(std::move(issuer_section));
+        }
+    }
+    std::vector<std::string> audiences{reader.Get("Global", "audience", "")};
+    result.reset(new ConfigSnapshot(audiences, sections, previous));
+    return true;
+}
+
+// The ACL mapping IssuerConfig::map_acl() replaced.
+void reference_map_acl(const std::vector<std::string> &base_paths, const std::vector<std::string> &restricted,
+                       const char *authz, const std::string &acl_path, AccessRulesRaw &rules)
+{
+    if (!restricted.empty()) {
+        bool found_path = false;
+        for (const auto &restricted_path : restricted) {
+            if (!strncmp(acl_path.c_str(), restricted_path.c_str(), restricted_path.size())) {
+                found_path = true;
+                break;
+            }
+        }
+        if (!found_path) {return;}
+    }
+    for (const auto &base_path : base_paths) {
+        std::string path = base_path == "/" ? acl_path :
+            (acl_path == "/" ? base_path : base_path + acl_path);
+        if (!strcmp(authz, "read")) {
+            rules.emplace_back(AOP_Read, path);
+            rules.emplace_back(AOP_Stat, path);
+        } else if (!strcmp(authz, "write")) {
+            rules.emplace_back(AOP_Update, path);
+            rules.emplace_back(AOP_Create, path);
+        }
+    }
+}
+
+int bench_loading(const std::string &path, size_t restricted)
+{
+    printf("%8s %12s %12s %12s   (ms, %zu restricted paths per issuer)\n", "issuers", "load", "unchanged",
+        "one edited", restricted);
+    for (size_t issuers : {10, 100, 1000, 10000}) {
+        write_config(path, issuers, restricted, issuers);
+        std::unique_ptr<ConfigSnapshot> first, second, third;
+        auto start = std::chrono::steady_clock::now();
+        if (!load(path, nullptr, first)) {return 1;}
+        auto load_ms = elapsed_ms(start);
+
+        start = std::chrono::steady_clock::now();
+        load(path, first.get(), second);
+        auto unchanged_ms = elapsed_ms(start);
+
+        write_config(path, issuers, restricted, issuers / 2);
+        start = std::chrono::steady_clock::now();
+        load(path, second.get(), third);
+        auto edited_ms = elapsed_ms(start);
+
+        if (first->m_issuers.size() != issuers || first->m_issuers_compiled != issuers ||
+            second->m_issuers_compiled != 0 || third->m_issuers_compiled != 1 ||
+            first->m_hash != second->m_hash || second->m_hash == third->m_hash)
+        {
+            fprintf(stderr, "%zu issuers: reloads recompiled %zu and %zu sections\n", issuers,
+                second->m_issuers_compiled, third->m_issuers_compiled);
+            return 1;
+        }
+        printf("%8zu %12.2f %12.2f %12.2f\n", issuers, load_ms, unchanged_ms, edited_ms);
+    }
+    return 0;
+}
+
+int bench_mapping(size_t acls)
+{
+    std::minstd_rand rng(42);
+    printf("\n%10s %12s %12s   (ns/ACL)\n", "restricted", "scan", "indexed");
+    for (size_t count : {10, 100, 1000, 10000}) {
+        IssuerSection section;
+        section.m_name = "bench";
+        section.m_url = "https://bench.example.org";
+        section.m_base_path = "/vo, /vo/scratch";
+        section.m_restricted_path = restricted_paths(0, count, "");
+        IssuerConfig config(section);
+        std::vector<std::string> base_paths, restricted;
+        scitokens_xrootd::ParseCanonicalPaths(section.m_base_path, base_paths);
+        scitokens_xrootd::ParseCanonicalPaths(section.m_restricted_path, restricted);
+
+        // Paths inside a restricted path, beside one (sharing a prefix that
+        // is not a path component) and outside all of them.
+        std::vector<std::string> paths;
+        for (size_t idx = 0; idx < 1024; idx++) {
+            auto project = "/data/0/project" + std::to_string(rng() % count);
+            switch (rng() % 3) {
+            case 0: paths.push_back(project + "/file" + std::to_string(idx)); break;
+            case 1: paths.push_back(project + "x"); break;
+            default: paths.push_back("/data/1/other" + std::to_string(idx)); break;
+            }
+        }
+
+        AccessRulesRaw expected, actual;
+        for (const auto &path : paths) {
+            for (auto authz : {"read", "write", "none"}) {
+                expected.clear();
+                actual.clear();
+                reference_map_acl(base_paths, restricted, authz, path, expected);
+                config.map_acl(authz, path, actual);
+                std::sort(expected.begin(), expected.end());
+                std::sort(actual.begin(), actual.end());
+                if (expected != actual) {
+                    fprintf(stderr, "%zu restricted paths: rules differ for %s %s\n", count, authz, path.c_str());
+                    return 1;
+                }
+            }
+        }
+
+        // The scan is quadratic in practice; keep its run short.
+        size_t scan_acls = std::max<size_t>(1000, acls / count);
+        AccessRulesRaw rules;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t idx = 0; idx < scan_acls; idx++) {
+            rules.clear();
+            reference_map_acl(base_paths, restricted, "read", paths[idx & 1023], rules);
+        }
+        auto scan_ns = elapsed_ms(start) * 1e6 / scan_acls;
+        start = std::chrono::steady_clock::now();
+        for (size_t idx = 0; idx < acls; idx++) {
+            rules.clear();
+            config.map_acl("read", paths[idx & 1023], rules);
+        }
+        auto indexed_ns = elapsed_ms(start) * 1e6 / acls;
+        printf("%10zu %12.1f %12.1f\n", count, scan_ns, indexed_ns);
+    }
+    return 0;
+}
+
+}
+
+
+int main(int argc, char *argv[])
+{
+    size_t acls = 1000000;
+    size_t restricted = 20;
+    int opt;
+    while ((opt = getopt(argc, argv, "a:r:")) != -1) {
+        switch (opt) {
+        case 'a': acls = strtoull(optarg, nullptr, 10); break;
+        case 'r': restricted = strtoull(optarg, nullptr, 10); break;
+        default:
+            fprintf(stderr, "Usage: %s [-a acls] [-r restricted_paths_per_issuer]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    char path[] = "/tmp/scitokens-config-bench.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    int result = bench_loading(path, restricted);
+    unlink(path);
+    return result ? result : bench_mapping(acls);
+}
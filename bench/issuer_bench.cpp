@@ -0,0 +1,109 @@
+// Check and time the perfect-hash table that routes a token to its issuer's
+// configuration.  For each table size, every configured issuer must map to
+// its own index and random near-misses (a changed, added or dropped
+// character) must map to none; then lookups are timed against the
+// std::unordered_map they replaced.
+//
+// Usage: scitokens-issuer-bench [-l lookups]
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "scitokens_issuers.hh"
+
+namespace {
+
+std::string random_issuer(std::minstd_rand &rng)
+{
+    static const char *hosts[] = {"https://cilogon.org/", "https://scitokens.org/", "https://wlcg.cern.ch/",
+                                  "https://token.example.edu/"};
+    std::string result = hosts[rng() % 4];
+    auto len = 1 + rng() % 24;
+    for (unsigned idx = 0; idx < len; idx++) {
+        result += "abcdefghijklmnopqrstuvwxyz0123456789-/"[rng() % 38];
+    }
+    return result;
+}
+
+std::string near_miss(std::string issuer, std::minstd_rand &rng)
+{
+    auto pos = rng() % issuer.size();
+    switch (rng() % 3) {
+    case 0: issuer[pos] = static_cast<char>(issuer[pos] ^ (1 + rng() % 127)); break;
+    case 1: issuer.insert(pos, 1, 'x'); break;
+    default: issuer.erase(pos, 1); break;
+    }
+    return issuer;
+}
+
+}
+
+
+int main(int argc, char *argv[])
+{
+    size_t lookups = 5000000;
+    int opt;
+    while ((opt = getopt(argc, argv, "l:")) != -1) {
+        switch (opt) {
+        case 'l': lookups = strtoull(optarg, nullptr, 10); break;
+        default:
+            fprintf(stderr, "Usage: %s [-l lookups]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::minstd_rand rng(42);
+    printf("%8s %12s %12s   (ns/lookup)\n", "issuers", "map", "table");
+    for (size_t count : {1, 2, 5, 20, 100, 1000}) {
+        std::vector<std::string> issuers;
+        std::unordered_map<std::string, int> map;
+        while (issuers.size() < count) {
+            auto issuer = random_issuer(rng);
+            if (map.emplace(issuer, issuers.size()).second) {issuers.push_back(issuer);}
+        }
+        scitokens_xrootd::IssuerTable table(issuers);
+
+        for (size_t idx = 0; idx < issuers.size(); idx++) {
+            if (table.find(issuers[idx]) != static_cast<int>(idx)) {
+                fprintf(stderr, "%zu issuers: %s not found\n", count, issuers[idx].c_str());
+                return 1;
+            }
+            for (unsigned miss = 0; miss < 20; miss++) {
+                auto other = near_miss(issuers[idx], rng);
+                auto iter = map.find(other);
+                int expected = iter == map.end() ? -1 : iter->second;
+                if (table.find(other) != expected) {
+                    fprintf(stderr, "%zu issuers: wrong result for %s\n", count, other.c_str());
+                    return 1;
+                }
+            }
+        }
+
+        // Mostly configured issuers, with one unknown in eight.
+        std::vector<std::string> queries;
+        for (size_t idx = 0; idx < 1024; idx++) {
+            queries.push_back(idx % 8 ? issuers[rng() % count] : random_issuer(rng));
+        }
+        volatile int sink = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t idx = 0; idx < lookups; idx++) {
+            auto iter = map.find(queries[idx & 1023]);
+            sink = sink + (iter == map.end() ? -1 : iter->second);
+        }
+        std::chrono::duration<double, std::nano> map_ns = std::chrono::steady_clock::now() - start;
+        start = std::chrono::steady_clock::now();
+        for (size_t idx = 0; idx < lookups; idx++) {
+            sink = sink + table.find(queries[idx & 1023]);
+        }
+        std::chrono::duration<double, std::nano> table_ns = std::chrono::steady_clock::now() - start;
+        printf("%8zu %12.1f %12.1f\n", count, map_ns.count() / lookups, table_ns.count() / lookups);
+    }
+    return 0;
+}
@@ -0,0 +1,107 @@
+// Time the JWT pre-screen used before a token is handed to scitokens-cpp:
+// every implementation (scalar, SSE2, AVX2 where the CPU has it) and the
+// byte-at-a-time loop it replaced, on tokens of realistic sizes.  That they
+// agree is checked by scitokens-jwt-test.
+//
+// Usage: scitokens-jwt-bench [-l scans]
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "legacy.hh"
+#include "scitokens_jwt.hh"
+
+using scitokens_xrootd::JwtSpans;
+
+namespace {
+
+struct Scanner
+{
+    const char *m_name;
+    bool (*m_scan)(const char *, size_t, JwtSpans &);
+};
+
+std::vector<Scanner> scanners()
+{
+    std::vector<Scanner> result{{"scalar", scitokens_xrootd::ScanJwtScalar}};
+#ifdef SCITOKENS_JWT_X86
+    result.push_back({"sse2", scitokens_xrootd::ScanJwtSse2});
+    if (scitokens_xrootd::CpuHasAvx2()) {
+        result.push_back({"avx2", scitokens_xrootd::ScanJwtAvx2});
+    }
+#endif
+    result.push_back({"dispatch", scitokens_xrootd::ScanJwt});
+    return result;
+}
+
+const char g_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+std::string random_segment(size_t len, std::minstd_rand &rng)
+{
+    std::string result;
+    for (size_t idx = 0; idx < len; idx++) {
+        result += g_alphabet[rng() % 64];
+    }
+    return result;
+}
+
+// An RS256-sized token: a short header, `payload` bytes of claims and a
+// 342-byte signature.
+std::string realistic_token(size_t payload, std::minstd_rand &rng)
+{
+    return random_segment(36, rng) + "." + random_segment(payload, rng) + "." + random_segment(342, rng);
+}
+
+}
+
+
+int main(int argc, char *argv[])
+{
+    size_t scans = 200000;
+    int opt;
+    while ((opt = getopt(argc, argv, "l:")) != -1) {
+        switch (opt) {
+        case 'l': scans = strtoull(optarg, nullptr, 10); break;
+        default:
+            fprintf(stderr, "Usage: %s [-l scans]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    auto all = scanners();
+    std::minstd_rand rng(42);
+
+    printf("%8s", "bytes");
+    printf(" %12s", "reference");
+    for (const auto &scanner : all) {printf(" %12s", scanner.m_name);}
+    printf("   (ns/token)\n");
+    for (size_t payload : {200, 600, 2000, 8000}) {
+        auto token = realistic_token(payload, rng);
+        printf("%8zu", token.size());
+        volatile bool sink = false;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t idx = 0; idx < scans; idx++) {
+            sink = legacy::ScanJwt(token);
+        }
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        printf(" %12.1f", elapsed.count() / scans);
+        for (const auto &scanner : all) {
+            JwtSpans spans;
+            start = std::chrono::steady_clock::now();
+            for (size_t idx = 0; idx < scans; idx++) {
+                sink = scanner.m_scan(token.data(), token.size(), spans);
+            }
+            elapsed = std::chrono::steady_clock::now() - start;
+            printf(" %12.1f", elapsed.count() / scans);
+        }
+        printf("\n");
+        (void)sink;
+    }
+    return 0;
+}
@@ -0,0 +1,256 @@
+
+// Load generator for XrdAccSciTokens::Access.  The plugin is loaded through
+// XrdAccAuthorizeObject exactly as the server would, with a locally generated
+// key standing in for the issuer's JWKS endpoint, and a configurable workload
+// is replayed against it:
+//
+//   -t threads        concurrent request threads (default: all cores)
+//   -N requests       total requests across all threads (default: 1000000)
+//   -n tokens         distinct tokens in the warm, cached set (default: 1000)
+//   -h hit_ratio      fraction of requests presenting a cached token; the rest
+//                     present a never-seen token (default: 0.99)
+//   -r rules          scopes per token (default: 2)
+//   -p depth          directories below the authorized prefix in each request
+//                     path (default: 3)
+//   -g key=value      extra [Global] option for the plugin; may be repeated
+//   -o file           also write the JSON report to this file
+//   -P max_p99_ns     exit with status 2 if p99 latency exceeds this
+//   -R min_rate       exit with status 2 if throughput (requests/sec) is lower
+//
+// A single line of JSON with the workload, throughput and latency percentiles
+// is printed on stdout, so runs can be compared and gated by scripts.  Every
+// request is expected to be authorized; any denial is reported and makes the
+// run fail.
+
+#include "XrdAcc/XrdAccAuthorize.hh"
+#include "XrdOuc/XrdOucEnv.hh"
+#include "XrdSec/XrdSecEntity.hh"
+#include "XrdSys/XrdSysLogger.hh"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "bench_tokens.hh"
+
+extern "C" XrdAccAuthorize *XrdAccAuthorizeObject(XrdSysLogger *lp, const char *cfn, const char *parm);
+
+namespace {
+
+const char g_issuer[] = "https://bench.scitokens.org";
+
+struct Workload
+{
+    unsigned m_threads{1};
+    uint64_t m_requests{1000000};
+    unsigned m_tokens{1000};
+    double m_hit_ratio{0.99};
+    unsigned m_rules{2};
+    unsigned m_depth{3};
+};
+
+// A token together with a request path it authorizes.
+struct Request
+{
+    std::unique_ptr<XrdOucEnv> m_env;
+    std::string m_path;
+};
+
+Request make_request(const bench::TokenMinter &minter, const Workload &workload,
+                     const std::string &subject, unsigned seed)
+{
+    std::string scope;
+    for (unsigned idx = 0; idx < workload.m_rules; idx++) {
+        scope += (idx ? " read:/" : "read:/") + subject + "/s" + std::to_string(idx);
+    }
+    Request request;
+    auto cgi = "authz=Bearer%20" + minter.mint(subject, scope, 3600);
+    request.m_env.reset(new XrdOucEnv(cgi.c_str()));
+    request.m_path = "/bench/" + subject + "/s" + std::to_string(seed % workload.m_rules);
+    for (unsigned idx = 0; idx < workload.m_depth; idx++) {
+        request.m_path += "/d" + std::to_string(idx);
+    }
+    request.m_path += "/file.dat";
+    return request;
+}
+
+// Request `idx` of a thread is a miss when it moves the running miss count
+// to the next integer, spreading misses evenly over the run.
+bool is_miss(uint64_t idx, double miss_ratio)
+{
+    return static_cast<uint64_t>((idx + 1) * miss_ratio) != static_cast<uint64_t>(idx * miss_ratio);
+}
+
+uint64_t percentile(const std::vector<uint32_t> &sorted, double fraction)
+{
+    if (sorted.empty()) {return 0;}
+    size_t idx = std::min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()));
+    return sorted[idx];
+}
+
+}
+
+
+int main(int argc, char *argv[])
+{
+    Workload workload;
+    workload.m_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::string> global_options;
+    std::string output_file;
+    uint64_t max_p99_ns = 0;
+    double min_rate = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:N:n:h:r:p:g:o:P:R:")) != -1) {
+        switch (opt) {
+        case 't': workload.m_threads = atoi(optarg); break;
+        case 'N': workload.m_requests = strtoull(optarg, nullptr, 10); break;
+        case 'n': workload.m_tokens = atoi(optarg); break;
+        case 'h': workload.m_hit_ratio = atof(optarg); break;
+        case 'r': workload.m_rules = atoi(optarg); break;
+        case 'p': workload.m_depth = atoi(optarg); break;
+        case 'g': global_options.push_back(optarg); break;
+        case 'o': output_file = optarg; break;
+        case 'P': max_p99_ns = strtoull(optarg, nullptr, 10); break;
+        case 'R': min_rate = atof(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-t threads] [-N requests] [-n tokens] [-h hit_ratio] [-r rules] "
+                "[-p depth] [-g key=value] [-o file] [-P max_p99_ns] [-R min_rate]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (!workload.m_threads || !workload.m_tokens || !workload.m_rules || !workload.m_requests ||
+        workload.m_hit_ratio < 0 || workload.m_hit_ratio > 1)
+    {
+        fprintf(stderr, "Threads, tokens, rules and requests must be positive and the hit ratio in [0, 1]\n");
+        return 1;
+    }
+    const double miss_ratio = 1 - workload.m_hit_ratio;
+    const uint64_t per_thread = (workload.m_requests + workload.m_threads - 1) / workload.m_threads;
+    const uint64_t misses_per_thread = static_cast<uint64_t>(per_thread * miss_ratio);
+
+    std::vector<Request> warm;
+    std::vector<std::vector<Request>> cold(workload.m_threads);
+    std::unique_ptr<XrdAccAuthorize> authz;
+    XrdSysLogger logger;
+    try {
+        auto key = bench::generate_key("bench");
+        bench::publish_key(g_issuer, key);
+        bench::TokenMinter minter(g_issuer, key);
+        fprintf(stderr, "Minting %u warm and %llu cold tokens\n", workload.m_tokens,
+            static_cast<unsigned long long>(misses_per_thread * workload.m_threads));
+        warm.reserve(workload.m_tokens);
+        for (unsigned idx = 0; idx < workload.m_tokens; idx++) {
+            warm.push_back(make_request(minter, workload, "user" + std::to_string(idx), idx));
+        }
+        for (unsigned tid = 0; tid < workload.m_threads; tid++) {
+            cold[tid].reserve(misses_per_thread);
+            for (uint64_t idx = 0; idx < misses_per_thread; idx++) {
+                cold[tid].push_back(make_request(minter, workload,
+                    "cold" + std::to_string(tid) + "_" + std::to_string(idx), idx));
+            }
+        }
+        auto parms = "config=" + bench::write_config(g_issuer, "/bench", global_options);
+        authz.reset(XrdAccAuthorizeObject(&logger, nullptr, parms.c_str()));
+    } catch (std::exception &exc) {
+        fprintf(stderr, "Load generator setup failed: %s\n", exc.what());
+        return 1;
+    }
+    if (!authz) {
+        fprintf(stderr, "Failed to load the SciTokens authorization plugin\n");
+        return 1;
+    }
+
+    for (auto &request : warm) {
+        XrdSecEntity entity("https");
+        authz->Access(&entity, request.m_path.c_str(), AOP_Read, request.m_env.get());
+        free(entity.name);
+    }
+
+    std::atomic<uint64_t> denied(0);
+    std::vector<std::vector<uint32_t>> latencies(workload.m_threads);
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned tid = 0; tid < workload.m_threads; tid++) {
+        workers.emplace_back([&, tid]() {
+            auto &samples = latencies[tid];
+            samples.reserve(per_thread);
+            size_t next_cold = 0;
+            uint64_t rng = tid * 0x9e3779b97f4a7c15ULL + 1;
+            uint64_t local_denied = 0;
+            for (uint64_t idx = 0; idx < per_thread; idx++) {
+                const Request *request;
+                if (is_miss(idx, miss_ratio) && next_cold < cold[tid].size()) {
+                    request = &cold[tid][next_cold++];
+                } else {
+                    rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+                    request = &warm[rng % warm.size()];
+                }
+                XrdSecEntity entity("https");
+                auto before = std::chrono::steady_clock::now();
+                auto result = authz->Access(&entity, request->m_path.c_str(), AOP_Read, request->m_env.get());
+                auto elapsed = std::chrono::steady_clock::now() - before;
+                free(entity.name);
+                samples.push_back(static_cast<uint32_t>(std::min<int64_t>(UINT32_MAX,
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count())));
+                if (result == XrdAccPriv_None) {local_denied++;}
+            }
+            denied += local_denied;
+        });
+    }
+    for (auto &worker : workers) {worker.join();}
+    std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+
+    std::vector<uint32_t> all;
+    all.reserve(per_thread * workload.m_threads);
+    for (const auto &samples : latencies) {
+        all.insert(all.end(), samples.begin(), samples.end());
+    }
+    std::sort(all.begin(), all.end());
+    double sum = 0;
+    for (auto sample : all) {sum += sample;}
+    const double rate = all.size() / wall.count();
+    const uint64_t p99 = percentile(all, 0.99);
+
+    std::stringstream ss;
+    ss << "{\"workload\": {\"threads\": " << workload.m_threads << ", \"requests\": " << all.size()
+       << ", \"tokens\": " << workload.m_tokens << ", \"hit_ratio\": " << workload.m_hit_ratio
+       << ", \"rules\": " << workload.m_rules << ", \"depth\": " << workload.m_depth << "}"
+       << ", \"denied\": " << denied.load()
+       << ", \"seconds\": " << wall.count()
+       << ", \"requests_per_sec\": " << static_cast<uint64_t>(rate)
+       << ", \"latency_ns\": {\"mean\": " << static_cast<uint64_t>(all.empty() ? 0 : sum / all.size())
+       << ", \"p50\": " << percentile(all, 0.5) << ", \"p99\": " << p99
+       << ", \"p999\": " << percentile(all, 0.999) << ", \"max\": " << (all.empty() ? 0 : all.back())
+       << "}}";
+    printf("%s\n", ss.str().c_str());
+    if (!output_file.empty()) {
+        std::ofstream out(output_file);
+        out << ss.str() << "\n";
+        if (!out) {
+            fprintf(stderr, "Failed to write %s\n", output_file.c_str());
+            return 1;
+        }
+    }
+
+    if (denied) {
+        fprintf(stderr, "%llu requests were unexpectedly denied\n",
+            static_cast<unsigned long long>(denied.load()));
+        return 1;
+    }
+    if ((max_p99_ns && p99 > max_p99_ns) || rate < min_rate) {
+        fprintf(stderr, "Performance gate failed\n");
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,71 @@
+// Time MakeCanonical against the vector/stringstream implementation it
+// replaced.  That the two agree is checked by scitokens-path-test.
+//
+// Usage: scitokens-path-bench [-l lookups]
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "legacy.hh"
+#include "scitokens_path.hh"
+
+namespace {
+
+template<typename Fn>
+double time_per_call(const std::vector<std::string> &paths, size_t lookups, Fn fn)
+{
+    volatile size_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t idx = 0; idx < lookups; idx++) {
+        sink = sink + fn(paths[idx % paths.size()]);
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / lookups;
+}
+
+}
+
+
+int main(int argc, char *argv[])
+{
+    size_t lookups = 2000000;
+    int opt;
+    while ((opt = getopt(argc, argv, "l:")) != -1) {
+        switch (opt) {
+        case 'l': lookups = strtoull(optarg, nullptr, 10); break;
+        default:
+            fprintf(stderr, "Usage: %s [-l lookups]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::string expected, actual;
+    const std::vector<std::pair<const char *, std::vector<std::string>>> workloads = {
+        {"request", {"/store/user/alice/data/run1/file.root", "/stash/osg/project/output/part-00017"}},
+        {"dotted", {"/store/user/alice/./data/../data/run1//file.root", "/stash/osg/../osg/project/./out/"}},
+        {"acl", {"/store/data//store/user/alice", "/stash/stash/osg/project"}},
+    };
+    printf("%10s %14s %14s %14s %10s\n", "paths", "old ns/op", "new ns/op", "request ns/op", "speedup");
+    for (const auto &workload : workloads) {
+        const auto &paths = workload.second;
+        auto old_ns = time_per_call(paths, lookups, [&](const std::string &path) {
+            legacy::MakeCanonical(path, expected);
+            return expected.size();
+        });
+        auto new_ns = time_per_call(paths, lookups, [&](const std::string &path) {
+            scitokens_xrootd::MakeCanonical(path, actual);
+            return actual.size();
+        });
+        auto request_ns = time_per_call(paths, lookups, [&](const std::string &path) {
+            return strlen(scitokens_xrootd::CanonicalRequestPath(path.c_str(), actual));
+        });
+        printf("%10s %14.1f %14.1f %14.1f %9.1fx\n", workload.first, old_ns, new_ns, request_ns,
+            old_ns / new_ns);
+    }
+    return 0;
+}
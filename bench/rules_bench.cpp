@@ -0,0 +1,208 @@
+
+// Compare XrdAccRules::apply against the linear scan over (operation, prefix)
+// pairs it replaced, for rule sets of 1 to 1000 entries, then time a
+// directory listing checked one path at a time against the batch form of
+// apply.  Before timing, the trie's answer for every probe path is checked
+// against a '/'-boundary aware linear reference, and the batch answers
+// against the single-path ones.
+//
+// Usage: scitokens-rules-bench [-l lookups]
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "scitokens_rules.hh"
+
+namespace {
+
+int add_priv(Access_Operation op, int privs)
+{
+    switch (op) {
+        case AOP_Read: return privs | XrdAccPriv_Read;
+        case AOP_Stat: return privs | XrdAccPriv_Lookup;
+        case AOP_Update: return privs | XrdAccPriv_Update;
+        case AOP_Create: return privs | XrdAccPriv_Create;
+        default: return privs;
+    }
+}
+
+// The previous implementation of XrdAccRules::apply.
+int linear_apply(const AccessRulesRaw &rules, std::string path)
+{
+    int privs = XrdAccPriv_None;
+    for (const auto &rule : rules) {
+        if (!path.compare(0, rule.second.size(), rule.second, 0, rule.second.size())) {
+            privs = add_priv(rule.first, privs);
+        }
+    }
+    return privs;
+}
+
+// Same, but only matching prefixes on a path component boundary.
+int reference_apply(const AccessRulesRaw &rules, const std::string &path)
+{
+    int privs = XrdAccPriv_None;
+    for (const auto &rule : rules) {
+        const auto &prefix = rule.second;
+        if (!path.compare(0, prefix.size(), prefix) &&
+            (prefix == "/" || path.size() == prefix.size() || path[prefix.size()] == '/'))
+        {
+            privs = add_priv(rule.first, privs);
+        }
+    }
+    return privs;
+}
+
+// Mimics GenerateAcls: each scope yields two rules under one of a few base paths.
+AccessRulesRaw make_rules(size_t count, std::minstd_rand &rng)
+{
+    static const char *base_paths[] = {"/stash", "/user/cms", "/store/data", "/osg"};
+    AccessRulesRaw rules;
+    while (rules.size() < count) {
+        std::string path = base_paths[rng() % 4];
+        auto depth = 1 + rng() % 4;
+        for (unsigned idx = 0; idx < depth; idx++) {
+            path += "/dir" + std::to_string(rng() % 8);
+        }
+        if (rng() % 2) {
+            rules.emplace_back(AOP_Read, path);
+            rules.emplace_back(AOP_Stat, path);
+        } else {
+            rules.emplace_back(AOP_Update, path);
+            rules.emplace_back(AOP_Create, path);
+        }
+    }
+    rules.resize(count);
+    return rules;
+}
+
+std::vector<std::string> make_paths(const AccessRulesRaw &rules, size_t count, std::minstd_rand &rng)
+{
+    std::vector<std::string> paths;
+    paths.reserve(count);
+    for (size_t idx = 0; idx < count; idx++) {
+        switch (rng() % 4) {
+        case 0: // Deep under an authorized prefix.
+            paths.push_back(rules[rng() % rules.size()].second + "/sub/file" + std::to_string(idx));
+            break;
+        case 1: // Exactly an authorized prefix.
+            paths.push_back(rules[rng() % rules.size()].second);
+            break;
+        case 2: // Shares a prefix but not on a component boundary.
+            paths.push_back(rules[rng() % rules.size()].second + "x/file");
+            break;
+        default: // Unrelated.
+            paths.push_back("/other/dir" + std::to_string(rng() % 8) + "/file");
+        }
+    }
+    return paths;
+}
+
+template<typename Fn>
+double time_per_call(const std::vector<std::string> &paths, size_t lookups, Fn fn)
+{
+    volatile int sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t idx = 0; idx < lookups; idx++) {
+        sink = sink + fn(paths[idx % paths.size()]);
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / lookups;
+}
+
+}
+
+
+int main(int argc, char *argv[])
+{
+    size_t lookups = 2000000;
+    int opt;
+    while ((opt = getopt(argc, argv, "l:")) != -1) {
+        switch (opt) {
+        case 'l': lookups = strtoull(optarg, nullptr, 10); break;
+        default:
+            fprintf(stderr, "Usage: %s [-l lookups]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::minstd_rand rng(42);
+    printf("%8s %14s %14s %10s %10s\n", "rules", "linear ns/op", "trie ns/op", "speedup", "bytes");
+    for (size_t count : {1, 10, 30, 100, 300, 1000}) {
+        auto raw = make_rules(count, rng);
+        auto paths = make_paths(raw, 4096, rng);
+        XrdAccRules rules("");
+        rules.parse(raw);
+
+        for (const auto &path : paths) {
+            auto expected = reference_apply(raw, path);
+            auto actual = rules.apply(AOP_Read, path.c_str());
+            if (expected != actual) {
+                fprintf(stderr, "Mismatch for %s with %zu rules: expected %#x, got %#x\n",
+                    path.c_str(), count, expected, static_cast<int>(actual));
+                return 1;
+            }
+        }
+
+        std::vector<const char *> batch_paths;
+        for (const auto &path : paths) {batch_paths.push_back(path.c_str());}
+        std::vector<XrdAccPrivs> batch_privs(paths.size());
+        rules.apply(batch_paths.data(), batch_paths.size(), batch_privs.data());
+        for (size_t idx = 0; idx < paths.size(); idx++) {
+            if (batch_privs[idx] != rules.apply(AOP_Read, paths[idx].c_str())) {
+                fprintf(stderr, "Batch mismatch for %s with %zu rules\n", paths[idx].c_str(), count);
+                return 1;
+            }
+        }
+
+        auto linear = time_per_call(paths, lookups, [&](const std::string &path) {
+            return linear_apply(raw, path);
+        });
+        auto trie = time_per_call(paths, lookups, [&](const std::string &path) {
+            return static_cast<int>(rules.apply(AOP_Read, path.c_str()));
+        });
+        printf("%8zu %14.1f %14.1f %9.1fx %10zu\n", count, linear, trie, linear / trie, rules.memory_usage());
+    }
+
+    printf("\n%8s %14s %14s %10s\n", "entries", "single ns/op", "batch ns/op", "speedup");
+    auto raw = make_rules(100, rng);
+    XrdAccRules rules("");
+    rules.parse(raw);
+    auto directory = raw[0].second + "/sub/dir";
+    for (size_t count : {10, 100, 1000, 10000}) {
+        std::vector<std::string> entries;
+        std::vector<const char *> batch_paths;
+        for (size_t idx = 0; idx < count; idx++) {
+            entries.push_back(directory + "/file" + std::to_string(idx));
+        }
+        for (const auto &entry : entries) {batch_paths.push_back(entry.c_str());}
+        std::vector<XrdAccPrivs> privs(count);
+        size_t rounds = std::max<size_t>(1, lookups / count);
+
+        volatile int sink = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t round = 0; round < rounds; round++) {
+            for (const auto &entry : entries) {
+                sink = sink + rules.apply(AOP_Stat, entry.c_str());
+            }
+        }
+        std::chrono::duration<double, std::nano> single = std::chrono::steady_clock::now() - start;
+        start = std::chrono::steady_clock::now();
+        for (size_t round = 0; round < rounds; round++) {
+            rules.apply(batch_paths.data(), count, privs.data());
+            sink = sink + privs[0];
+        }
+        std::chrono::duration<double, std::nano> batch = std::chrono::steady_clock::now() - start;
+        auto single_ns = single.count() / (rounds * count);
+        auto batch_ns = batch.count() / (rounds * count);
+        printf("%8zu %14.1f %14.1f %9.1fx\n", count, single_ns, batch_ns, single_ns / batch_ns);
+    }
+    return 0;
+}
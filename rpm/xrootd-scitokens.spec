@@ -13,10 +13,19 @@ BuildRequires: gcc-c++
 BuildRequires: cmake
 BuildRequires: xrootd-server-devel
 BuildRequires: scitokens-cpp-devel
+BuildRequires: openssl-devel
 
 %description
 SciTokens authentication plugin for XRootD
 
+%package devel
+Summary: Batch authorization API of the SciTokens plugin for XRootD
+Requires: %{name} = %{version}-%{release}
+
+%description devel
+Header declaring the batch authorization API of the SciTokens plugin for
+XRootD, for callers that authorize many paths for one client at once.
+
 %prep
 %setup -q
 
@@ -26,6 +35,10 @@ cd build
 %cmake ..
 make 
 
+%check
+cd build
+ctest --output-on-failure
+
 %install
 pushd build
 rm -rf $RPM_BUILD_ROOT
@@ -47,6 +60,10 @@ rm -rf $RPM_BUILD_ROOT
 
 %defattr(-,root,root,-)
 
+%files devel
+%{_includedir}/xrootd-scitokens/scitokens_batch.hh
+
+
 %changelog
 * Thu May 16 2019 Derek Weitzel <dweitzel@cse.unl.edu> - 1.0.0-1
 - Switch from the SciTokens Python API to the C API
@@ -5,13 +5,22 @@
 #include "XrdSys/XrdSysLogger.hh"
 #include "XrdVersion.hh"
 
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <map>
-#include <memory>
 #include <mutex>
+#include <memory>
 #include <string>
 #include <vector>
 #include <sstream>
 #include <unordered_map>
+#include <thread>
 #include <tuple>
 
 #include "INIReader.h"
@@ -19,6 +28,20 @@
 
 #include "scitokens/scitokens.h"
 
+#include "scitokens_audit.hh"
+#include "scitokens_batch.hh"
+#include "scitokens_cache.hh"
+#include "scitokens_cache_file.hh"
+#include "scitokens_config.hh"
+#include "scitokens_issuers.hh"
+#include "scitokens_jwt.hh"
+#include "scitokens_keys.hh"
+#include "scitokens_metrics.hh"
+#include "scitokens_path.hh"
+#include "scitokens_rules.hh"
+#include "scitokens_shared_cache.hh"
+#include "scitokens_workers.hh"
+
 XrdVERSIONINFO(XrdAccAuthorizeObject, XrdAccSciTokens);
 
 // The status-quo to retrieve the default object is to copy/paste the
@@ -30,336 +53,629 @@ extern XrdAccAuthorize *XrdAccDefaultAuthorizeObject(XrdSysLogger   *lp,
                                                      XrdVersionInfo &myVer);
 
 
+using scitokens_xrootd::AuditIdentity;
+using scitokens_xrootd::CanonicalRequestPath;
+using scitokens_xrootd::ConfigSnapshot;
+using scitokens_xrootd::IssuerSection;
+using scitokens_xrootd::MakeCanonical;
+using scitokens_xrootd::monotonic_time;
+using scitokens_xrootd::monotonic_time_ms;
+using scitokens_xrootd::wall_time_ms;
+using scitokens_xrootd::Counter;
+using scitokens_xrootd::ScopedTimer;
+using scitokens_xrootd::Timer;
+
 namespace {
 
-typedef std::vector<std::pair<Access_Operation, std::string>> AccessRulesRaw;
+// Source of configuration generation numbers for all plugin instances.
+std::atomic<uint64_t> g_config_generations{0};
 
-inline uint64_t monotonic_time() {
-  struct timespec tp;
-#ifdef CLOCK_MONOTONIC_COARSE
-  clock_gettime(CLOCK_MONOTONIC_COARSE, &tp);
-#else
-  clock_gettime(CLOCK_MONOTONIC, &tp);
-#endif
-  return tp.tv_sec + (tp.tv_nsec >= 500000000);
 }
 
-XrdAccPrivs AddPriv(Access_Operation op, XrdAccPrivs privs)
-{
-    int new_privs = privs;
-    switch (op) {
-        case AOP_Any:
-            break;
-        case AOP_Chmod:
-            new_privs |= static_cast<int>(XrdAccPriv_Chmod);
-            break;
-        case AOP_Chown:
-            new_privs |= static_cast<int>(XrdAccPriv_Chown);
-            break;
-        case AOP_Create:
-            new_privs |= static_cast<int>(XrdAccPriv_Create);
-            break;
-        case AOP_Delete:
-            new_privs |= static_cast<int>(XrdAccPriv_Delete);
-            break;
-        case AOP_Insert:
-            new_privs |= static_cast<int>(XrdAccPriv_Insert);
-            break;
-        case AOP_Lock:
-            new_privs |= static_cast<int>(XrdAccPriv_Lock);
-            break;
-        case AOP_Mkdir:
-            new_privs |= static_cast<int>(XrdAccPriv_Mkdir);
-            break;
-        case AOP_Read:
-            new_privs |= static_cast<int>(XrdAccPriv_Read);
-            break;
-        case AOP_Readdir:
-            new_privs |= static_cast<int>(XrdAccPriv_Readdir);
-            break;
-        case AOP_Rename:
-            new_privs |= static_cast<int>(XrdAccPriv_Rename);
-            break;
-        case AOP_Stat:
-            new_privs |= static_cast<int>(XrdAccPriv_Lookup);
-            break;
-        case AOP_Update:
-            new_privs |= static_cast<int>(XrdAccPriv_Update);
-            break;
-    };
-    return static_cast<XrdAccPrivs>(new_privs);
-}
 
-bool MakeCanonical(const std::string &path, std::string &result)
+class XrdAccSciTokens : public XrdAccAuthorize, public XrdAccBatchAuthorize
 {
-    if (path.empty() || path[0] != '/') {return false;}
-
-    size_t pos = 0;
-    std::vector<std::string> components;
-    do {
-        while (path.size() > pos && path[pos] == '/') {pos++;}
-        auto next_pos = path.find_first_of("/", pos);
-        auto next_component = path.substr(pos, next_pos - pos);
-        pos = next_pos;
-        if (next_component.empty() || next_component == ".") {continue;}
-        else if (next_component == "..") {
-            if (!components.empty()) {
-                components.pop_back();
-            }
-        } else {
-            components.emplace_back(next_component);
+public:
+    XrdAccSciTokens(XrdSysLogger *lp, const char *parms, std::unique_ptr<XrdAccAuthorize> chain) :
+        m_chain(std::move(chain)),
+        m_parms(parms ? parms : ""),
+        m_cache(m_cache_shards),
+        m_negative_cache(m_cache_shards, m_negative_cache_entries, m_negative_cache_secs, m_expiry_secs),
+        m_chain_cache(m_cache_shards, m_chain_cache_entries),
+        m_log(lp, "scitokens_"),
+        m_keys(m_log, m_metrics),
+        m_audit(m_log, m_metrics)
+    {
+        m_log.Say("++++++ XrdAccSciTokens: Initialized SciTokens-based authorization.");
+        if (!Reconfig()) {
+            throw std::runtime_error("Failed to configure SciTokens authorization.");
         }
-    } while (pos != std::string::npos);
-    if (components.empty()) {
-        result = "/";
-        return true;
-    }
-    std::stringstream ss;
-    for (const auto &comp : components) {
-        ss << "/" << comp;
+        if (m_verify_threads) {
+            m_verify_pool.reset(new scitokens_xrootd::WorkerPool(m_verify_threads, m_verify_queue));
+        }
+        if (!m_cache_file.empty()) {
+            LoadCache();
+        }
+        m_maintenance_thread = std::thread(&XrdAccSciTokens::Maintenance, this);
+        m_keys.start();
     }
-    result = ss.str();
-    return true;
-}
 
-void ParseCanonicalPaths(const std::string &path, std::vector<std::string> &results)
-{
-    size_t pos = 0;
-    do {
-        while (path.size() > pos && (path[pos] == ',' || path[pos] == ' ')) {pos++;}
-        auto next_pos = path.find_first_of(", ", pos);
-        auto next_path = path.substr(pos, next_pos - pos);
-        pos = next_pos;
-        if (!next_path.empty()) {
-            std::string canonical_path;
-            if (MakeCanonical(next_path, canonical_path)) {
-                results.emplace_back(std::move(canonical_path));
-            }
+    virtual ~XrdAccSciTokens() {
+        {
+            std::lock_guard<std::mutex> guard(m_maintenance_mutex);
+            m_shutdown = true;
         }
-    } while (pos != std::string::npos);
-}
-
-struct IssuerConfig
-{
-    IssuerConfig(const std::string &issuer_name,
-                 const std::string &issuer_url,
-                 const std::vector<std::string> &base_paths,
-                 const std::vector<std::string> &restricted_paths,
-                 bool map_subject,
-                 const std::string &default_user)
-        : m_map_subject(map_subject),
-          m_name(issuer_name),
-          m_url(issuer_url),
-          m_default_user(default_user),
-          m_base_paths(base_paths),
-          m_restricted_paths(restricted_paths)
-    {}
-
-    const bool m_map_subject;
-    const std::string m_name;
-    const std::string m_url;
-    const std::string m_default_user;
-    const std::vector<std::string> m_base_paths;
-    const std::vector<std::string> m_restricted_paths;
-};
-
-}
-
+        m_maintenance_cv.notify_all();
+        if (m_maintenance_thread.joinable()) {
+            m_maintenance_thread.join();
+        }
+        // Validations still queued finish as failures; those running are
+        // cached, and saved below.
+        m_verify_pool.reset();
+        if (!m_cache_file.empty()) {
+            SaveCache();
+        }
+    }
 
-class XrdAccRules
-{
-public:
-    XrdAccRules(uint64_t expiry_time, const std::string &username) :
-        m_expiry_time(expiry_time),
-        m_username(username)
-    {}
-
-    ~XrdAccRules() {}
-
-    XrdAccPrivs apply(Access_Operation, std::string path) {
-        XrdAccPrivs privs = XrdAccPriv_None;
-        for (const auto & rule : m_rules) {
-            if (!path.compare(0, rule.second.size(), rule.second, 0, rule.second.size())) {
-                privs = AddPriv(rule.first, privs);
-            }
+    virtual XrdAccPrivs Access(const XrdSecEntity *Entity,
+                                  const char         *path,
+                                  const Access_Operation oper,
+                                        XrdOucEnv       *env) override
+    {
+        if (!m_audit.sample()) {
+            return Decide(Entity, path, oper, env, nullptr);
         }
-        return privs;
+        auto start = std::chrono::steady_clock::now();
+        AuditIdentity identity;
+        auto result = Decide(Entity, path, oper, env, &identity);
+        identity.m_user = Entity ? Entity->name : nullptr;
+        m_audit.append(identity, path, oper, result, ElapsedNs(start));
+        return result;
     }
 
-    bool expired() const {return monotonic_time() > m_expiry_time;}
+    virtual void AccessBatch(const XrdSecEntity *Entity, XrdAccBatchRequest *requests, size_t count,
+                             XrdOucEnv *env) override
+    {
+        if (!m_audit.sample()) {
+            DecideBatch(Entity, requests, count, env, nullptr);
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        AuditIdentity identity;
+        DecideBatch(Entity, requests, count, env, &identity);
+        identity.m_user = Entity ? Entity->name : nullptr;
+        // Each decision is charged the latency of the whole batch.
+        uint64_t latency_ns = ElapsedNs(start);
+        for (size_t idx = 0; idx < count; idx++) {
+            m_audit.append(identity, requests[idx].m_path, requests[idx].m_oper, requests[idx].m_privs, latency_ns);
+        }
+    }
 
-    void parse(const AccessRulesRaw &rules) {
-        m_rules.reserve(rules.size());
-        for (const auto &entry : rules) {
-            m_rules.emplace_back(entry.first, entry.second);
+    // Outcomes that XRootD reports here are recorded in the audit log, if
+    // one is configured, alongside the decisions made by Access().
+    virtual int Audit(const int              accok,
+                      const XrdSecEntity    *Entity,
+                      const char            *path,
+                      const Access_Operation oper,
+                            XrdOucEnv       *Env=0) override
+    {
+        if (m_audit.sample()) {
+            AuditIdentity identity;
+            identity.m_user = Entity ? Entity->name : nullptr;
+            const char *authz = Env ? Env->Get("authz") : nullptr;
+            if (authz) {
+                identity.m_token = true;
+                identity.m_digest = scitokens_xrootd::TokenDigest(authz, strlen(authz)).m_words[0];
+            }
+            m_audit.append(identity, path, oper, static_cast<XrdAccPrivs>(accok), 0, true);
         }
+        return 0;
     }
 
-    const std::string & get_username() const {return m_username;}
+    virtual int         Test(const XrdAccPrivs priv,
+                             const Access_Operation oper) override
+    {
+        return 0;
+    }
 
 private:
-    AccessRulesRaw m_rules;
-    uint64_t m_expiry_time{0};
-    const std::string m_username;
-};
 
+    static uint64_t ElapsedNs(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
 
-class XrdAccSciTokens : public XrdAccAuthorize
-{
-public:
-    XrdAccSciTokens(XrdSysLogger *lp, const char *parms, std::unique_ptr<XrdAccAuthorize> chain) :
-        m_chain(std::move(chain)),
-        m_parms(parms ? parms : ""),
-        m_next_clean(monotonic_time() + m_expiry_secs),
-        m_log(lp, "scitokens_")
+    // Records who the rules were issued to in `identity`, when the decision
+    // is being audited.  Copies the strings, so for cached rules it must be
+    // called before the epoch guard is released.
+    static void SetIdentity(const XrdAccRules &rules, AuditIdentity *identity)
     {
-        pthread_rwlock_init(&m_config_lock, nullptr);
-        m_config_lock_initialized = true;
-        m_log.Say("++++++ XrdAccSciTokens: Initialized SciTokens-based authorization.");
-        if (!Reconfig()) {
-            throw std::runtime_error("Failed to configure SciTokens authorization.");
+        if (identity) {
+            identity->set_issued_to(rules.get_issuer().get(), rules.get_subject().get());
         }
     }
 
-    virtual ~XrdAccSciTokens() {
-        if (m_config_lock_initialized) {
-            pthread_rwlock_destroy(&m_config_lock);
+    XrdAccPrivs Decide(const XrdSecEntity *Entity, const char *path, const Access_Operation oper, XrdOucEnv *env,
+                       AuditIdentity *identity)
+    {
+        const char *authz = env ? env->Get("authz") : nullptr;
+        if (authz == nullptr) {
+            return ChainAccess(Entity, path, oper, env);
+        }
+        // Keeps its capacity, so only the first long path a thread sees allocates.
+        static thread_local std::string path_buffer;
+        uint64_t now = monotonic_time_ms();
+        const scitokens_xrootd::TokenDigest digest(authz, strlen(authz));
+        if (identity) {
+            identity->m_token = true;
+            identity->m_digest = digest.m_words[0];
+        }
+        XrdAccPrivs result = XrdAccPriv_None;
+        bool hit;
+        {
+            // A hit borrows the cached rules without copying the shared_ptr;
+            // the guard keeps them alive until it is released.
+            scitokens_xrootd::EpochDomain::Guard guard(m_cache.epochs());
+            const XrdAccRules *cached = m_cache.get(digest, now, guard);
+            hit = cached != nullptr;
+            if (hit) {
+                SetUsername(*cached, Entity);
+                SetIdentity(*cached, identity);
+                result = cached->apply(oper, CanonicalRequestPath(path, path_buffer));
+            }
         }
+        if (hit) {
+            m_metrics.increment(Counter::CacheHit);
+        } else {
+            auto access_rules = Resolve(authz, digest, now);
+            if (!access_rules) {
+                m_metrics.increment(Counter::ChainFallback);
+                return ChainAccess(Entity, path, oper, env);
+            }
+            SetUsername(*access_rules, Entity);
+            SetIdentity(*access_rules, identity);
+            result = access_rules->apply(oper, CanonicalRequestPath(path, path_buffer));
+        }
+        if (result == XrdAccPriv_None && m_chain) {
+            m_metrics.increment(Counter::ChainFallback);
+            return ChainAccess(Entity, path, oper, env);
+        }
+        return result;
     }
 
-    virtual XrdAccPrivs Access(const XrdSecEntity *Entity,
-                                  const char         *path,
-                                  const Access_Operation oper,
-                                        XrdOucEnv       *env) override
+    void DecideBatch(const XrdSecEntity *Entity, XrdAccBatchRequest *requests, size_t count, XrdOucEnv *env,
+                     AuditIdentity *identity)
     {
+        m_metrics.increment(Counter::BatchAccess);
+        for (size_t idx = 0; idx < count; idx++) {
+            requests[idx].m_privs = XrdAccPriv_None;
+        }
         const char *authz = env ? env->Get("authz") : nullptr;
         if (authz == nullptr) {
-            return m_chain ? m_chain->Access(Entity, path, oper, env) : XrdAccPriv_None;
+            ChainBatch(Entity, requests, count, env);
+            return;
         }
-        std::shared_ptr<XrdAccRules> access_rules;
-        uint64_t now = monotonic_time();
-        Check(now);
+        std::vector<const char *> paths(count);
+        std::vector<std::string> path_buffers(count);
+        std::vector<XrdAccPrivs> privs(count, XrdAccPriv_None);
+        for (size_t idx = 0; idx < count; idx++) {
+            paths[idx] = CanonicalRequestPath(requests[idx].m_path, path_buffers[idx]);
+        }
+
+        uint64_t now = monotonic_time_ms();
+        const scitokens_xrootd::TokenDigest digest(authz, strlen(authz));
+        if (identity) {
+            identity->m_token = true;
+            identity->m_digest = digest.m_words[0];
+        }
+        bool hit;
         {
-            std::lock_guard<std::mutex> guard(m_mutex);
-            const auto iter = m_map.find(authz);
-            if (iter != m_map.end() && !iter->second->expired()) {
-                access_rules = iter->second;
+            scitokens_xrootd::EpochDomain::Guard guard(m_cache.epochs());
+            const XrdAccRules *cached = m_cache.get(digest, now, guard);
+            hit = cached != nullptr;
+            if (hit) {
+                SetUsername(*cached, Entity);
+                SetIdentity(*cached, identity);
+                cached->apply(paths.data(), count, privs.data());
             }
         }
-        if (!access_rules) {
-            try {
-		uint64_t cache_expiry;
-		AccessRulesRaw rules;
-                std::string username;
-                if (GenerateAcls(authz, cache_expiry, rules, username)) {
-                    access_rules.reset(new XrdAccRules(now + cache_expiry, username));
-                    access_rules->parse(rules);
+        if (hit) {
+            m_metrics.increment(Counter::CacheHit);
+        } else if (auto access_rules = Resolve(authz, digest, now)) {
+            SetUsername(*access_rules, Entity);
+            SetIdentity(*access_rules, identity);
+            access_rules->apply(paths.data(), count, privs.data());
+        }
+        for (size_t idx = 0; idx < count; idx++) {
+            requests[idx].m_privs = privs[idx];
+            if (privs[idx] == XrdAccPriv_None && m_chain) {m_metrics.increment(Counter::ChainFallback);}
+        }
+        ChainBatch(Entity, requests, count, env);
+    }
+
+    // XRootD expects the entity to carry the mapped username, which it
+    // frees, so it is copied only if unset.
+    static void SetUsername(const XrdAccRules &rules, const XrdSecEntity *Entity)
+    {
+        const std::string &username = rules.get_username();
+        if (!username.empty() && !Entity->name) {
+            const_cast<XrdSecEntity*>(Entity)->name = strdup(username.c_str());
+        }
+    }
+
+    // Find the rules for a token that missed the cache, validating it unless
+    // another thread already is or it was recently rejected; returns nullptr
+    // if the token is not acceptable, or if the verification pool is full or
+    // does not validate it within verify_timeout_ms.
+    std::shared_ptr<XrdAccRules> Resolve(const char *authz, const scitokens_xrootd::TokenDigest &digest,
+                                         uint64_t now)
+    {
+        // The negative cache only needs a resolution of seconds.
+        uint64_t repeats;
+        if (m_negative_cache.contains(digest, now / 1000, repeats)) {
+            m_metrics.increment(Counter::NegativeHit);
+            if (repeats) {
+                std::string count = std::to_string(repeats);
+                m_log.Emsg("Access", "Previously rejected token presented again; attempts since last report:",
+                    count.c_str());
+            }
+            return nullptr;
+        }
+
+        m_metrics.increment(Counter::CacheMiss);
+        std::shared_ptr<scitokens_xrootd::TokenCache::Validation> validation;
+        bool leader;
+        auto access_rules = m_cache.acquire(digest, now, validation, leader);
+        if (access_rules) {return access_rules;}
+        uint64_t timeout_ms = m_verify_timeout_ms.load(std::memory_order_relaxed);
+        if (leader) {
+            if (!m_verify_pool) {
+                return Verify(authz, digest, validation);
+            }
+            // Hand the validation to the pool so a burst of new tokens
+            // cannot occupy every XRootD thread; the pool finishes it even if
+            // this thread stops waiting, and caches the result for the next
+            // request.
+            std::string token(authz);
+            bool queued = m_verify_pool->submit([this, token, digest, validation](bool expired) {
+                if (expired) {
+                    m_metrics.increment(Counter::VerifyExpired);
+                    uint64_t now = monotonic_time_ms();
+                    m_cache.complete(digest, validation, nullptr, now, now);
                 } else {
-                    return m_chain ? m_chain->Access(Entity, path, oper, env) : XrdAccPriv_None;
+                    Verify(token.c_str(), digest, validation);
                 }
-            } catch (std::exception &exc) {
-                m_log.Emsg("Access", "Error generating ACLs for authorization", exc.what());
-                return m_chain ? m_chain->Access(Entity, path, oper, env) : XrdAccPriv_None;
+            }, now + timeout_ms);
+            if (!queued) {
+                // The token is not known to be bad, so it is not added to
+                // the negative cache.
+                m_metrics.increment(Counter::VerifyRejected);
+                m_cache.complete(digest, validation, nullptr, now, now);
+                return nullptr;
             }
-            std::lock_guard<std::mutex> guard(m_mutex);
-            m_map[authz] = access_rules;
+        } else {
+            m_metrics.increment(Counter::ValidationWait);
         }
-        const std::string &username = access_rules->get_username();
-        if (!username.empty() && !Entity->name) {
-            const_cast<XrdSecEntity*>(Entity)->name = strdup(username.c_str());
+        if (!validation->wait_for(timeout_ms, access_rules)) {
+            m_metrics.increment(Counter::VerifyTimeout);
+            return nullptr;
         }
-        XrdAccPrivs result = access_rules->apply(oper, path);
-        return ((result == XrdAccPriv_None) && m_chain) ? m_chain->Access(Entity, path, oper, env) : result;
+        return access_rules;
     }
 
-    virtual int Audit(const int              accok,
-                      const XrdSecEntity    *Entity,
-                      const char            *path,
-                      const Access_Operation oper,
-                            XrdOucEnv       *Env=0) override
+    // Validate a token as the leader of `validation`, recording the result
+    // in the caches; returns nullptr if the token is not acceptable.
+    std::shared_ptr<XrdAccRules> Verify(const char *authz, const scitokens_xrootd::TokenDigest &digest,
+                                        const std::shared_ptr<scitokens_xrootd::TokenCache::Validation> &validation)
     {
-        return 0;
+        // Measured from the start of validation, which may have waited in
+        // the pool's queue.
+        uint64_t now = monotonic_time_ms();
+        // Read before the snapshot, so a rejection under a configuration
+        // that Reconfig() has since replaced is not remembered.
+        uint64_t negative_generation = m_negative_cache.generation();
+        // One snapshot for the whole validation, so rules are shared under
+        // the hash of the configuration that produced them even if Reconfig()
+        // publishes a new one in the meantime.
+        std::shared_ptr<const ConfigSnapshot> config = GetConfig();
+        uint64_t lifetime_ms = 0;
+        auto access_rules = GetShared(digest, config->m_hash, lifetime_ms);
+        if (!access_rules) {
+            bool definitive = false;
+            access_rules = ValidateToken(authz, *config, lifetime_ms, definitive);
+            if (!access_rules && definitive) {
+                m_negative_cache.insert(digest, negative_generation, now / 1000);
+            } else if (access_rules && lifetime_ms) {
+                PutShared(digest, config->m_hash, *access_rules, lifetime_ms);
+            }
+        }
+        // The entry is valid through its last millisecond, so one with no
+        // lifetime is not cached at all.
+        m_cache.complete(digest, validation, access_rules, now + lifetime_ms - 1, now);
+        return access_rules;
     }
 
-    virtual int         Test(const XrdAccPrivs priv,
-                             const Access_Operation oper) override
+    // The rules another process on this host validated for the token, if a
+    // shared cache is configured and has them; `lifetime_ms` is set to how
+    // long they remain valid.  Never throws, as the caller leads a validation.
+    std::shared_ptr<XrdAccRules> GetShared(const scitokens_xrootd::TokenDigest &digest, uint64_t config_hash,
+                                           uint64_t &lifetime_ms)
     {
-        return 0;
+        auto shared_cache = std::atomic_load(&m_shared_cache);
+        if (!shared_cache) {return nullptr;}
+        std::shared_ptr<XrdAccRules> rules;
+        try {
+            int64_t now = wall_time_ms();
+            int64_t expiry;
+            rules = shared_cache->get(digest, config_hash, now, expiry);
+            if (rules) {lifetime_ms = expiry - now;}
+        } catch (std::exception &exc) {
+            m_log.Emsg("Access", "Failed to read the shared token cache:", exc.what());
+        }
+        m_metrics.increment(rules ? Counter::SharedCacheHit : Counter::SharedCacheMiss);
+        return rules;
     }
 
-private:
+    // Offer the rules just validated for a token to the other processes.
+    void PutShared(const scitokens_xrootd::TokenDigest &digest, uint64_t config_hash, const XrdAccRules &rules,
+                   uint64_t lifetime_ms)
+    {
+        auto shared_cache = std::atomic_load(&m_shared_cache);
+        if (!shared_cache) {return;}
+        try {
+            shared_cache->put(digest, config_hash, wall_time_ms() + lifetime_ms, rules);
+        } catch (std::exception &exc) {
+            m_log.Emsg("Access", "Failed to update the shared token cache:", exc.what());
+        }
+    }
+
+    // Everything the default authorizer's decision depends on: the entity's
+    // protocol and identities, the path as requested and the operation.
+    static scitokens_xrootd::TokenDigest ChainKey(const XrdSecEntity *Entity, const char *path,
+                                                  Access_Operation oper)
+    {
+        // Keeps its capacity, so building a key does not allocate.
+        static thread_local std::string key;
+        key.clear();
+        // Fields cannot contain a NUL, so they are unambiguous once
+        // terminated; the prefix tells an unset field from an empty one.
+        auto append = [](const char *field) {
+            key += field ? '+' : '-';
+            if (field) {key += field;}
+            key += '\0';
+        };
+        append(Entity->prot);
+        append(Entity->name);
+        append(Entity->host);
+        append(Entity->vorg);
+        append(Entity->role);
+        append(Entity->grps);
+        key.append(reinterpret_cast<const char *>(&oper), sizeof(oper));
+        key += path;
+        return scitokens_xrootd::TokenDigest(key.data(), key.size());
+    }
+
+    // Ask the chained authorizer, reusing its recent decisions for the same
+    // entity, path and operation.
+    XrdAccPrivs ChainAccess(const XrdSecEntity *Entity, const char *path, const Access_Operation oper,
+                            XrdOucEnv *env)
+    {
+        if (!m_chain) {return XrdAccPriv_None;}
+        uint64_t lifetime_ms = m_chain_cache_ms.load(std::memory_order_relaxed);
+        if (!lifetime_ms || !Entity || !path) {return m_chain->Access(Entity, path, oper, env);}
+
+        auto key = ChainKey(Entity, path, oper);
+        uint64_t now = monotonic_time_ms();
+        int privs;
+        if (m_chain_cache.get(key, now, privs)) {
+            m_metrics.increment(Counter::ChainCacheHit);
+            return static_cast<XrdAccPrivs>(privs);
+        }
+        m_metrics.increment(Counter::ChainCacheMiss);
+        auto generation = m_chain_cache.generation();
+        auto result = m_chain->Access(Entity, path, oper, env);
+        m_chain_cache.insert(key, generation, now + lifetime_ms - 1, result);
+        return result;
+    }
+
+    // Pass the requests nothing else authorized to the chained authorizer,
+    // itself in one batch if it supports them; those it decided recently
+    // are answered from its result cache.
+    void ChainBatch(const XrdSecEntity *Entity, XrdAccBatchRequest *requests, size_t count, XrdOucEnv *env)
+    {
+        if (!m_chain) {return;}
+        uint64_t lifetime_ms = m_chain_cache_ms.load(std::memory_order_relaxed);
+        bool use_cache = lifetime_ms && Entity;
+        uint64_t now = monotonic_time_ms();
+        auto generation = m_chain_cache.generation();
+        std::vector<XrdAccBatchRequest> denied;
+        std::vector<size_t> positions;
+        std::vector<scitokens_xrootd::TokenDigest> keys;
+        for (size_t idx = 0; idx < count; idx++) {
+            auto &request = requests[idx];
+            if (request.m_privs != XrdAccPriv_None) {continue;}
+            if (use_cache && request.m_path) {
+                auto key = ChainKey(Entity, request.m_path, request.m_oper);
+                int privs;
+                if (m_chain_cache.get(key, now, privs)) {
+                    m_metrics.increment(Counter::ChainCacheHit);
+                    request.m_privs = static_cast<XrdAccPrivs>(privs);
+                    continue;
+                }
+                m_metrics.increment(Counter::ChainCacheMiss);
+                keys.push_back(key);
+            } else {
+                // Keeps `keys` aligned with `denied`; never stored.
+                keys.emplace_back();
+            }
+            denied.push_back(request);
+            positions.push_back(idx);
+        }
+        if (denied.empty()) {return;}
+        XrdAccAccessBatch(*m_chain, Entity, denied.data(), denied.size(), env);
+        for (size_t idx = 0; idx < denied.size(); idx++) {
+            requests[positions[idx]].m_privs = denied[idx].m_privs;
+            if (use_cache && denied[idx].m_path) {
+                m_chain_cache.insert(keys[idx], generation, now + lifetime_ms - 1, denied[idx].m_privs);
+            }
+        }
+    }
+
+    // Build the access rules for a token not found in the cache; returns
+    // nullptr if the token is not acceptable.  `lifetime_ms` is set to how
+    // long the rules may be cached, and `definitive` whether a rejection
+    // would stand if the token were presented again: the token is malformed,
+    // expired, names an unknown issuer or none of the accepted audiences, or
+    // fails verification against keys already in the key cache.  Anything
+    // that could succeed on a retry, such as a key download that failed, is
+    // not definitive.
+    std::shared_ptr<XrdAccRules> ValidateToken(const std::string &authz, const ConfigSnapshot &config_snapshot,
+                                               uint64_t &lifetime_ms, bool &definitive)
+    {
+        ScopedTimer timer(m_metrics, Timer::Validate);
+        std::shared_ptr<XrdAccRules> access_rules;
+        try {
+            AccessRulesRaw rules;
+            std::string username, issuer, subject;
+            if (GenerateAcls(authz, config_snapshot, lifetime_ms, definitive, rules, username, issuer, subject)) {
+                access_rules.reset(new XrdAccRules(username, issuer, subject));
+                access_rules->parse(rules);
+                m_metrics.increment(Counter::Validated);
+            }
+        } catch (std::exception &exc) {
+            m_log.Emsg("Access", "Error generating ACLs for authorization", exc.what());
+            m_metrics.increment(Counter::RejectedException);
+            access_rules.reset();
+            definitive = false;
+        }
+        return access_rules;
+    }
 
-    bool GenerateAcls(const std::string &authz, uint64_t &cache_expiry, AccessRulesRaw &rules, std::string &username) {
+    bool GenerateAcls(const std::string &authz, const ConfigSnapshot &config_snapshot, uint64_t &lifetime_ms,
+                      bool &definitive, AccessRulesRaw &rules, std::string &username, std::string &issuer,
+                      std::string &subject) {
+        definitive = true;
         if (strncmp(authz.c_str(), "Bearer%20", 9)) {
+            m_metrics.increment(Counter::RejectedMalformed);
             return false;
         }
 
         // Does this look like a JWT?  If not, bail out early and
         // do not pollute the log.
-        bool looks_good = true;
-        int separator_count = 0;
-        for (auto cur_char = authz.c_str() + 9; *cur_char; cur_char++) {
-            if (*cur_char == '.') {
-                separator_count++;
-                if (separator_count > 2) {
-                    break;
-                }
-            } else
-            if (!(*cur_char >= 65 && *cur_char <= 90) && // uppercase letters
-                !(*cur_char >= 97 && *cur_char <= 122) && // lowercase letters
-                !(*cur_char >= 48 && *cur_char <= 57) && // numbers
-                (*cur_char != 43) && (*cur_char != 47) && // + and /
-                (*cur_char != 45) && (*cur_char != 95)) // - and _
-            {
-                looks_good = false;
-                break;
-            }
+        scitokens_xrootd::JwtSpans spans;
+        if (!scitokens_xrootd::ScanJwt(authz.c_str() + 9, authz.size() - 9, spans)) {
+            m_metrics.increment(Counter::RejectedMalformed);
+            return false;
+        }
+
+        // Turn away tokens that could never be accepted before any signature
+        // verification or key download.  Nothing in the payload is trusted
+        // yet: the issuer is checked again once the token is verified.
+        scitokens_xrootd::JwtClaims claims;
+        if (!scitokens_xrootd::PeekJwtClaims(authz.c_str() + 9, spans.m_payload, claims)) {
+            m_log.Emsg("GenerateAcls", "Token payload is not a JSON object.");
+            m_metrics.increment(Counter::RejectedMalformed);
+            return false;
+        }
+        auto issuer_config = config_snapshot.find_issuer(claims.m_issuer);
+        if (!issuer_config) {
+            m_log.Emsg("GenerateAcls", "Token issuer is not configured:", claims.m_issuer.c_str());
+            m_metrics.increment(Counter::RejectedUnknownIssuer);
+            return false;
         }
-        if ((separator_count != 2) || (!looks_good)) {
+        // An expired token never becomes valid again, and the accepted
+        // audiences only change with the configuration, whose reload clears
+        // the negative cache.
+        int64_t wall_now = wall_time_ms();
+        if (claims.m_expiry > 0 && claims.m_expiry * 1000 <= wall_now) {
+            m_log.Emsg("GenerateAcls", "Token has already expired.");
+            m_metrics.increment(Counter::RejectedExpired);
             return false;
         }
+        if (!config_snapshot.accepts_audience(claims.m_audiences)) {
+            m_log.Emsg("GenerateAcls", "Token audience is not accepted by this server.");
+            m_metrics.increment(Counter::RejectedAudience);
+            return false;
+        }
+        // Key, enforcer and ACL failures are left to be checked again.
+        definitive = false;
 
         char *err_msg;
         SciToken token = nullptr;
-        pthread_rwlock_rdlock(&m_config_lock);
-        auto retval = scitoken_deserialize(authz.c_str() + 9, &token, &m_valid_issuers_array[0], &err_msg);
-        pthread_rwlock_unlock(&m_config_lock);
+        ScopedTimer deserialize_timer(m_metrics, Timer::Deserialize);
+        auto retval = scitoken_deserialize(authz.c_str() + 9, &token, &config_snapshot.m_valid_issuers_array[0], &err_msg);
+        deserialize_timer.stop();
         if (retval) {
+            m_metrics.increment(Counter::RejectedDeserialize);
             // This originally looked like a JWT so log the failure.
             m_log.Emsg("GenerateAcls", "Failed to deserialize SciToken:", err_msg);
             free(err_msg);
+            // With the signing key at hand the signature itself is bad;
+            // without it, fetching the key failed and may yet succeed.
+            std::string key_id;
+            definitive = !scitokens_xrootd::PeekJwtKeyId(authz.c_str() + 9, spans.m_header, key_id) ||
+                scitokens_xrootd::HasCachedKey(issuer_config->m_url, key_id);
             return false;
         }
 
         long long expiry;
         if (scitoken_get_expiration(token, &expiry, &err_msg)) {
             m_log.Emsg("GenerateAcls", "Unable to determine token expiration:", err_msg);
+            m_metrics.increment(Counter::RejectedExpired);
             free(err_msg);
             scitoken_destroy(token);
             return false;
         }
+        // `exp` is wall-clock time; convert it to a lifetime so the cache,
+        // which runs on the monotonic clock, keeps the entry until the token
+        // itself expires, to the millisecond.  Tokens without an expiration
+        // are re-validated periodically.
+        int64_t lifetime = m_expiry_secs * 1000;
         if (expiry > 0) {
-            expiry = std::max(static_cast<int64_t>(monotonic_time() - expiry),
-                static_cast<int64_t>(60));
-        } else {
-            expiry = 60;
+            lifetime = expiry * 1000 - wall_now;
+            if (lifetime <= 0) {
+                m_log.Emsg("GenerateAcls", "Token has already expired.");
+                m_metrics.increment(Counter::RejectedExpired);
+                definitive = true;
+                scitoken_destroy(token);
+                return false;
+            }
+        }
+        // A token accepted shortly before its `nbf`, within the verifier's
+        // allowance for clock skew, is re-validated on every use until it
+        // takes effect rather than cached.
+        if (claims.m_not_before * 1000 > wall_now) {
+            lifetime = 0;
         }
 
         char *value = nullptr;
         if (scitoken_get_claim_string(token, "iss", &value, &err_msg)) {
             m_log.Emsg("GenerateAcls", "Failed to get issuer:", err_msg);
+            m_metrics.increment(Counter::RejectedUnknownIssuer);
+            definitive = true;
             scitoken_destroy(token);
             free(err_msg);
             return false;
         }
-        std::string issuer(value);
+        // The signature covers the payload, so this only differs from the
+        // issuer routed on if the two parsers disagree about it.
+        bool issuer_matches = issuer_config->m_url == value;
         free(value);
+        if (!issuer_matches) {
+            m_log.Emsg("GenerateAcls", "Verified issuer differs from the token payload.");
+            m_metrics.increment(Counter::RejectedUnknownIssuer);
+            definitive = true;
+            scitoken_destroy(token);
+            return false;
+        }
 
-        pthread_rwlock_rdlock(&m_config_lock);
-        auto enf = enforcer_create(issuer.c_str(), &m_audiences_array[0], &err_msg);
-        pthread_rwlock_unlock(&m_config_lock);
+        // enforcer_create does not modify the audience list despite its signature.
+        ScopedTimer enforcer_timer(m_metrics, Timer::Enforcer);
+        auto &enforcers = issuer_config->m_enforcers;
+        auto enf = enforcers.acquire(const_cast<const char **>(&config_snapshot.m_audiences_array[0]), &err_msg);
         if (!enf) {
             m_log.Emsg("GenerateAcls", "Failed to create an enforcer:", err_msg);
+            m_metrics.increment(Counter::RejectedEnforcer);
             scitoken_destroy(token);
             free(err_msg);
             return false;
@@ -368,77 +684,70 @@ private:
         Acl *acls = nullptr;
         if (enforcer_generate_acls(enf, token, &acls, &err_msg)) {
             scitoken_destroy(token);
-            enforcer_destroy(enf);
+            enforcers.release(enf);
             m_log.Emsg("GenerateAcls", "ACL generation from SciToken failed:", err_msg);
+            m_metrics.increment(Counter::RejectedAcls);
             free(err_msg);
             return false;
         }
-        enforcer_destroy(enf);
+        enforcers.release(enf);
+        enforcer_timer.stop();
 
-        pthread_rwlock_rdlock(&m_config_lock);
-        auto iter = m_issuers.find(issuer);
-        if (iter == m_issuers.end()) {
-            pthread_rwlock_unlock(&m_config_lock);
-            m_log.Emsg("GenerateAcls", "Authorized issuer without a config.");
-            scitoken_destroy(token);
-            return false;
-        }
-        const auto &config = iter->second;
+        ScopedTimer mapping_timer(m_metrics, Timer::AclMapping);
+        const auto &config = *issuer_config;
         std::string token_username;
-        if (config.m_map_subject) {
-            value = nullptr;
-            if (scitoken_get_claim_string(token, "sub", &value, &err_msg)) {
-                pthread_rwlock_unlock(&m_config_lock);
-                m_log.Emsg("GenerateAcls", "Failed to get token subject:", err_msg);
-                free(err_msg);
-                scitoken_destroy(token);
-                return false;
-            }
-            token_username = std::string(value);
+        std::string token_subject;
+        value = nullptr;
+        if (!scitoken_get_claim_string(token, "sub", &value, &err_msg)) {
+            token_subject = std::string(value);
             free(value);
+        } else if (config.m_map_subject) {
+            m_log.Emsg("GenerateAcls", "Failed to get token subject:", err_msg);
+            m_metrics.increment(Counter::RejectedSubject);
+            free(err_msg);
+            enforcer_acl_free(acls);
+            scitoken_destroy(token);
+            return false;
         } else {
-            token_username = config.m_default_user;
+            // Only the audit log would have recorded it.
+            free(err_msg);
         }
+        token_username = config.m_map_subject ? token_subject : config.m_default_user;
 
         AccessRulesRaw xrd_rules;
+        std::string acl_path;
         int idx = 0;
         while (acls[idx].resource && acls[idx++].authz) {
-            const auto &acl_path = acls[idx-1].resource;
             const auto &acl_authz = acls[idx-1].authz;
-            if (!config.m_restricted_paths.empty()) {
-                bool found_path = false;
-                for (const auto &restricted_path : config.m_restricted_paths) {
-                    if (!strncmp(acl_path, restricted_path.c_str(), restricted_path.size())) {
-                        found_path = true;
-                        break;
-                    }
-                }
-                if (!found_path) {continue;}
-            }
-            for (const auto &base_path : config.m_base_paths) {
-                if (!acl_path[0] || acl_path[0] != '/') {continue;}
-                std::string path;
-                MakeCanonical(base_path + acl_path, path);
-                if (!strcmp(acl_authz, "read")) {
-                    xrd_rules.emplace_back(AOP_Read, path);
-                    xrd_rules.emplace_back(AOP_Stat, path);
-                } else if (!strcmp(acl_authz, "write")) {
-                    xrd_rules.emplace_back(AOP_Update, path);
-                    xrd_rules.emplace_back(AOP_Create, path);
-                }
-            }
+            // Canonicalize the ACL on its own so ".." stops at the base path
+            // instead of climbing out of it.
+            if (!MakeCanonical(acls[idx-1].resource, strlen(acls[idx-1].resource), acl_path)) {continue;}
+            config.map_acl(acl_authz, acl_path, xrd_rules);
         }
+        enforcer_acl_free(acls);
+        scitoken_destroy(token);
 
-        pthread_rwlock_unlock(&m_config_lock);
-
-        cache_expiry = expiry;
+        lifetime_ms = lifetime;
         rules = std::move(xrd_rules);
         username = std::move(token_username);
+        issuer = config.m_url;
+        subject = std::move(token_subject);
 
         return true;
     }
 
     bool Reconfig()
+    {
+        ScopedTimer timer(m_metrics, Timer::Reconfig);
+        bool success = ParseConfig();
+        // The administrator may have changed the default authorization along
+        // with this plugin's; decide every request afresh.
+        m_chain_cache.clear();
+        m_metrics.increment(success ? Counter::Reconfig : Counter::ReconfigFailed);
+        return success;
+    }
+
+    bool ParseConfig()
     {
         errno = 0;
         std::string cfg_file("/etc/xrootd/scitokens.cfg");
@@ -464,6 +773,8 @@ private:
             }
         }
         m_log.Emsg("Reconfig", "Parsing configuration file:", cfg_file.c_str());
+        m_cfg_file = cfg_file;
+        m_cfg_stat = StatConfig(cfg_file);
 
         INIReader reader(cfg_file);
         if (reader.ParseError() < 0) {
@@ -478,13 +789,83 @@ private:
             return false;
         }
         std::vector<std::string> audiences;
-        std::unordered_map<std::string, IssuerConfig> issuers;
+        std::vector<IssuerSection> issuer_sections;
+        long cache_max_entries = m_default_cache_max_entries;
+        long cache_max_bytes = m_default_cache_max_bytes;
+        std::string metrics_file;
+        std::string cache_file;
+        std::string shared_cache_file;
+        long shared_cache_entries = m_default_shared_cache_entries;
+        long metrics_interval = m_default_metrics_interval;
+        long key_refresh_interval = m_default_key_refresh_interval;
+        long chain_cache_lifetime = m_default_chain_cache_lifetime;
+        long verify_threads = m_default_verify_threads;
+        long verify_queue = m_default_verify_queue;
+        long verify_timeout_ms = m_default_verify_timeout_ms;
+        std::string audit_file;
+        double audit_sample_rate = 1;
+        long audit_max_bytes = m_default_audit_max_bytes;
+        long audit_max_files = m_default_audit_max_files;
+        std::vector<scitokens_xrootd::KeySource> key_sources;
         for (const auto &section : reader.Sections()) {
             std::string section_lower;
             std::transform(section.begin(), section.end(), std::back_inserter(section_lower),
                 [](unsigned char c){ return std::tolower(c); });
 
             if (section_lower.substr(0, 6) == "global") {
+                cache_max_entries = reader.GetInteger(section, "cache_max_entries", cache_max_entries);
+                cache_max_bytes = reader.GetInteger(section, "cache_max_bytes", cache_max_bytes);
+                if (cache_max_entries < 0 || cache_max_bytes < 0) {
+                    m_log.Emsg("Reconfig", "cache_max_entries and cache_max_bytes must not be negative.");
+                    return false;
+                }
+                cache_file = reader.Get(section, "cache_file", cache_file);
+                shared_cache_file = reader.Get(section, "shared_cache_file", shared_cache_file);
+                shared_cache_entries = reader.GetInteger(section, "shared_cache_entries", shared_cache_entries);
+                if (shared_cache_entries <= 0) {
+                    m_log.Emsg("Reconfig", "shared_cache_entries must be positive.");
+                    return false;
+                }
+                metrics_file = reader.Get(section, "metrics_file", metrics_file);
+                metrics_interval = reader.GetInteger(section, "metrics_interval", metrics_interval);
+                if (metrics_interval <= 0) {
+                    m_log.Emsg("Reconfig", "metrics_interval must be positive.");
+                    return false;
+                }
+                key_refresh_interval = reader.GetInteger(section, "key_refresh_interval", key_refresh_interval);
+                if (key_refresh_interval < 0) {
+                    m_log.Emsg("Reconfig", "key_refresh_interval must not be negative.");
+                    return false;
+                }
+                chain_cache_lifetime = reader.GetInteger(section, "chain_cache_lifetime", chain_cache_lifetime);
+                if (chain_cache_lifetime < 0) {
+                    m_log.Emsg("Reconfig", "chain_cache_lifetime must not be negative.");
+                    return false;
+                }
+                verify_threads = reader.GetInteger(section, "verify_threads", verify_threads);
+                verify_queue = reader.GetInteger(section, "verify_queue", verify_queue);
+                if (verify_threads < 0 || verify_queue <= 0) {
+                    m_log.Emsg("Reconfig", "verify_threads must not be negative and verify_queue must be positive.");
+                    return false;
+                }
+                verify_timeout_ms = reader.GetInteger(section, "verify_timeout_ms", verify_timeout_ms);
+                if (verify_timeout_ms <= 0) {
+                    m_log.Emsg("Reconfig", "verify_timeout_ms must be positive.");
+                    return false;
+                }
+                audit_file = reader.Get(section, "audit_file", audit_file);
+                audit_sample_rate = reader.GetReal(section, "audit_sample_rate", audit_sample_rate);
+                if (!(audit_sample_rate >= 0 && audit_sample_rate <= 1)) {
+                    m_log.Emsg("Reconfig", "audit_sample_rate must be between 0 and 1.");
+                    return false;
+                }
+                audit_max_bytes = reader.GetInteger(section, "audit_max_bytes", audit_max_bytes);
+                audit_max_files = reader.GetInteger(section, "audit_max_files", audit_max_files);
+                if (audit_max_bytes < 0 || audit_max_files < 0) {
+                    m_log.Emsg("Reconfig", "audit_max_bytes and audit_max_files must not be negative.");
+                    return false;
+                }
+
                 auto audience = reader.Get(section, "audience", "");
                 if (!audience.empty()) {
                     size_t pos = 0;
@@ -522,110 +903,292 @@ private:
 
             if (section_lower.substr(0, 7) != "issuer ") {continue;}
 
-            auto issuer = reader.Get(section, "issuer", "");
-            if (issuer.empty()) {
-                m_log.Emsg("Reconfig", "Ignoring section because 'issuer' attribute is not set:",
-                     section.c_str());
+            IssuerSection issuer_section;
+            std::string err;
+            if (!scitokens_xrootd::ReadIssuerSection(reader, section, issuer_section, err)) {
+                m_log.Emsg("Reconfig", err.c_str(), section.c_str());
                 continue;
             }
 
-            auto base_path = reader.Get(section, "base_path", "");
-            if (base_path.empty()) {
-                m_log.Emsg("Reconfig", "Ignoring section because 'base_path' attribute is not set:",
-                     section.c_str());
-                continue;
-            }
+            scitokens_xrootd::KeySource key_source;
+            key_source.m_issuer = issuer_section.m_url;
+            key_source.m_jwks_file = issuer_section.m_jwks_file;
+            key_sources.push_back(key_source);
+            issuer_sections.push_back(std::move(issuer_section));
+        }
+        if (issuer_sections.empty()) {
+            m_log.Emsg("Reconfig", "No issuers configured.");
+            return false;
+        }
 
-            size_t pos = 7;
-            while (section.size() > pos && std::isspace(section[pos])) {pos++;}
+        // Sections unchanged since the last load keep their compiled form.
+        std::shared_ptr<const ConfigSnapshot> config_snapshot;
+        try {
+            config_snapshot.reset(new ConfigSnapshot(std::move(audiences), issuer_sections,
+                                                     std::atomic_load(&m_config).get()));
+        } catch (...) {
+            return false;
+        }
+        auto old_config = std::atomic_exchange(&m_config, config_snapshot);
+        m_config_generation.store(g_config_generations.fetch_add(1, std::memory_order_relaxed) + 1,
+                                  std::memory_order_release);
+        // Cached ACLs were derived from the old settings; drop them if the
+        // settings they depend on have changed.
+        if (old_config && old_config->m_hash != config_snapshot->m_hash) {
+            m_log.Emsg("Reconfig", "Issuer configuration changed; clearing the token caches.");
+            m_cache.clear();
+            m_negative_cache.clear();
+        }
+        m_cache.set_limits(cache_max_entries, cache_max_bytes);
+        // Only read by the maintenance thread, which is also the only caller
+        // of Reconfig() once the constructor has returned.
+        m_cache_file = cache_file;
+        UpdateSharedCache(shared_cache_file, shared_cache_entries);
+        m_metrics_file = metrics_file;
+        m_metrics_interval = metrics_interval;
+        m_keys.set_sources(key_sources, key_refresh_interval);
+        m_chain_cache_ms.store(chain_cache_lifetime * 1000, std::memory_order_relaxed);
+        // The pool is sized once, by the constructor; a reload only changes
+        // how long requests wait on it.
+        if (!m_verify_pool) {
+            m_verify_threads = verify_threads;
+            m_verify_queue = verify_queue;
+        } else if (verify_threads != m_verify_threads || verify_queue != m_verify_queue) {
+            m_log.Emsg("Reconfig", "verify_threads and verify_queue only take effect on restart.");
+        }
+        m_verify_timeout_ms.store(verify_timeout_ms, std::memory_order_relaxed);
+        m_audit.configure(audit_file, audit_sample_rate, audit_max_bytes, audit_max_files);
+        return true;
+    }
 
-            auto name = section.substr(pos);
-            if (name.empty()) {
-                m_log.Emsg("Reconfig", "Invalid section name:", section.c_str());
-                continue;
-            }
+    // Returns the current configuration snapshot.  Each thread keeps its own
+    // reference to the snapshot and only re-fetches it when the generation
+    // counter moves, so the common case is a single shared read with no lock
+    // and no reference-count write.  Generations are unique across all
+    // instances, so a new instance allocated at a destroyed one's address
+    // never matches a stale thread-local snapshot.  The returned reference
+    // stays valid until the same thread calls GetConfig() again.
+    const std::shared_ptr<const ConfigSnapshot> &GetConfig() const
+    {
+        struct ThreadConfig
+        {
+            uint64_t m_generation{0};
+            std::shared_ptr<const ConfigSnapshot> m_config;
+        };
+        static thread_local ThreadConfig thread_config;
+
+        auto generation = m_config_generation.load(std::memory_order_acquire);
+        if (thread_config.m_generation != generation) {
+            thread_config.m_config = std::atomic_load(&m_config);
+            thread_config.m_generation = generation;
+        }
+        return thread_config.m_config;
+    }
 
-            std::vector<std::string> base_paths;
-            ParseCanonicalPaths(base_path, base_paths);
+    struct ConfigStat
+    {
+        dev_t m_dev{0};
+        ino_t m_ino{0};
+        off_t m_size{0};
+        struct timespec m_mtime{0, 0};
+
+        bool operator==(const ConfigStat &other) const {
+            return m_dev == other.m_dev && m_ino == other.m_ino && m_size == other.m_size &&
+                m_mtime.tv_sec == other.m_mtime.tv_sec && m_mtime.tv_nsec == other.m_mtime.tv_nsec;
+        }
+    };
 
-            auto restricted_path = reader.Get(section, "restricted_path", "");
-            std::vector<std::string> restricted_paths;
-            if (!restricted_path.empty()) {
-                ParseCanonicalPaths(restricted_path, restricted_paths);
-            }
+    static ConfigStat StatConfig(const std::string &cfg_file)
+    {
+        ConfigStat result;
+        struct stat st;
+        if (stat(cfg_file.c_str(), &st) == 0) {
+            result.m_dev = st.st_dev;
+            result.m_ino = st.st_ino;
+            result.m_size = st.st_size;
+            result.m_mtime = st.st_mtim;
+        }
+        return result;
+    }
 
-            auto default_user = reader.Get(section, "default_user", "");
-            auto map_subject = reader.GetBoolean(section, "map_subject", false);
+    // Map the shared cache named in the configuration, keeping the current
+    // mapping if it is unchanged.  Failing to map it is not fatal: the
+    // process then relies on its own cache alone.
+    void UpdateSharedCache(const std::string &path, long entries)
+    {
+        auto current = std::atomic_load(&m_shared_cache);
+        if (current ? (current->path() == path && m_shared_cache_entries == entries) : path.empty()) {return;}
+        m_shared_cache_entries = entries;
+        std::shared_ptr<scitokens_xrootd::SharedTokenCache> shared_cache;
+        if (!path.empty()) {
+            std::string err;
+            shared_cache = scitokens_xrootd::SharedTokenCache::open(path, entries, err);
+            if (shared_cache) {
+                m_log.Emsg("Reconfig", "Sharing validated tokens through", path.c_str());
+            } else {
+                m_log.Emsg("Reconfig", err.c_str());
+            }
+        }
+        // Threads still using the old mapping keep it alive.
+        std::atomic_store(&m_shared_cache, shared_cache);
+    }
 
-            issuers.emplace(std::piecewise_construct,
-                            std::forward_as_tuple(issuer),
-                            std::forward_as_tuple(name, issuer, base_paths, restricted_paths,
-                                                  map_subject, default_user));
+    // Restores the token cache saved by a previous process, keeping only the
+    // entries derived from the current issuer configuration.
+    void LoadCache()
+    {
+        size_t loaded;
+        std::string err;
+        if (!scitokens_xrootd::LoadCacheFile(m_cache_file, std::atomic_load(&m_config)->m_hash, m_cache,
+                                             loaded, err))
+        {
+            m_log.Emsg("LoadCache", err.c_str());
         }
-        if (issuers.empty()) {
-            m_log.Emsg("Reconfig", "No issuers configured.");
-            return false;
+        if (loaded) {
+            m_log.Emsg("LoadCache", "Restored cached tokens:", std::to_string(loaded).c_str());
         }
+    }
 
-        pthread_rwlock_wrlock(&m_config_lock);
+    void SaveCache()
+    {
+        size_t saved;
+        std::string err;
         try {
-            m_audiences = std::move(audiences);
-            size_t idx = 0;
-            m_audiences_array.reserve(m_audiences.size() + 1);
-            for (const auto &audience : m_audiences) {
-                m_audiences_array[idx++] = audience.c_str();
-            }
-            m_audiences_array[idx] = nullptr;
-
-            m_issuers = std::move(issuers);
-            m_valid_issuers.clear();
-            m_valid_issuers.reserve(m_issuers.size());
-            m_valid_issuers_array.reserve(m_issuers.size() + 1);
-            idx = 0;
-            for (const auto &issuer : m_valid_issuers) {
-                m_valid_issuers_array[idx++] = issuer.c_str();
+            if (!scitokens_xrootd::SaveCacheFile(m_cache_file, std::atomic_load(&m_config)->m_hash, m_cache,
+                                                 saved, err))
+            {
+                m_log.Emsg("SaveCache", err.c_str());
             }
-            m_valid_issuers_array[idx] = nullptr;
-        } catch (...) {
-            pthread_rwlock_unlock(&m_config_lock);
-            return false;
+        } catch (std::exception &exc) {
+            m_log.Emsg("SaveCache", "Failed to save the token cache:", exc.what());
         }
-        pthread_rwlock_unlock(&m_config_lock);
-        return true;
     }
 
-    void Check(uint64_t now)
+    // Writes the current metrics as a single line of JSON to the configured
+    // metrics file.  The file is replaced atomically so readers never see a
+    // partial write.
+    void ExportMetrics()
     {
-        if (now <= m_next_clean) {return;}
-        std::lock_guard<std::mutex> guard(m_mutex);
+        if (m_metrics_file.empty()) {return;}
+        auto json = scitokens_xrootd::Metrics::to_json(m_metrics.snapshot(), {
+            {"cache_entries", m_cache.size()},
+            {"cache_bytes", m_cache.bytes()},
+            {"negative_cache_entries", m_negative_cache.size()},
+            {"chain_cache_entries", m_chain_cache.size()},
+            {"verify_queue", m_verify_pool ? m_verify_pool->queued() : 0}});
+        json += "\n";
+
+        auto tmp_file = m_metrics_file + ".tmp";
+        FILE *fp = fopen(tmp_file.c_str(), "w");
+        if (!fp) {
+            m_log.Emsg("ExportMetrics", "Unable to open metrics file", tmp_file.c_str(), strerror(errno));
+            return;
+        }
+        bool failed = fwrite(json.data(), 1, json.size(), fp) != json.size();
+        failed = fclose(fp) || failed;
+        if (failed || rename(tmp_file.c_str(), m_metrics_file.c_str())) {
+            m_log.Emsg("ExportMetrics", "Unable to write metrics file", m_metrics_file.c_str(), strerror(errno));
+            unlink(tmp_file.c_str());
+        }
+    }
 
-        for (auto iter = m_map.begin(); iter != m_map.end(); iter++) {
-            if (iter->second->expired()) {
-                m_map.erase(iter);
+    // Runs in a dedicated thread: every tick removes the cache entries whose
+    // deadlines have passed, at most a fixed number per shard, so expired
+    // tokens are dropped within about a tick of expiring without the cost of
+    // a tick growing with the cache.  Less often, it re-reads the
+    // configuration file when it has been replaced or modified, saves the
+    // cache to the cache file and exports the metrics.  Request threads never
+    // pay for any of these.
+    void Maintenance()
+    {
+        uint64_t next_reconfig = monotonic_time() + m_expiry_secs;
+        uint64_t next_export = monotonic_time() + m_metrics_interval;
+
+        std::unique_lock<std::mutex> guard(m_maintenance_mutex);
+        while (!m_shutdown) {
+            m_maintenance_cv.wait_for(guard, std::chrono::milliseconds(m_maintenance_tick_ms),
+                                      [&]{return m_shutdown;});
+            if (m_shutdown) {break;}
+            guard.unlock();
+
+            m_cache.expire(monotonic_time_ms(), m_expire_per_tick);
+            uint64_t now = monotonic_time();
+            if (now >= next_reconfig) {
+                if (!(StatConfig(m_cfg_file) == m_cfg_stat)) {
+                    Reconfig();
+                }
+                if (!m_cache_file.empty()) {
+                    SaveCache();
+                }
+                next_reconfig = now + m_expiry_secs;
+            }
+            if (now >= next_export) {
+                ExportMetrics();
+                next_export = now + m_metrics_interval;
             }
-        }
-        Reconfig();
 
-        m_next_clean = monotonic_time() + m_expiry_secs;
+            guard.lock();
+        }
     }
 
-    bool m_config_lock_initialized{false};
-    std::mutex m_mutex;
-    pthread_rwlock_t m_config_lock;
-    std::vector<std::string> m_audiences;
-    std::vector<const char *> m_audiences_array;
-    std::map<std::string, std::shared_ptr<XrdAccRules>> m_map;
+    std::shared_ptr<const ConfigSnapshot> m_config;
+    std::atomic<uint64_t> m_config_generation{0};
     std::unique_ptr<XrdAccAuthorize> m_chain;
     const std::string m_parms;
-    std::vector<std::string> m_valid_issuers;
-    std::vector<const char*> m_valid_issuers_array;
-    std::unordered_map<std::string, IssuerConfig> m_issuers;
-    uint64_t m_next_clean{0};
+    scitokens_xrootd::TokenCache m_cache;
+    scitokens_xrootd::NegativeCache m_negative_cache;
+    scitokens_xrootd::ChainCache m_chain_cache;
+    // Zero disables m_chain_cache.
+    std::atomic<uint64_t> m_chain_cache_ms{0};
+    std::string m_cfg_file;
+    ConfigStat m_cfg_stat;
     XrdSysError m_log;
+    std::mutex m_maintenance_mutex;
+    std::condition_variable m_maintenance_cv;
+    bool m_shutdown{false};
+    std::thread m_maintenance_thread;
+    scitokens_xrootd::Metrics m_metrics;
+    std::string m_cache_file;
+    std::shared_ptr<scitokens_xrootd::SharedTokenCache> m_shared_cache;
+    long m_shared_cache_entries{0};
+    std::string m_metrics_file;
+    uint64_t m_metrics_interval{m_default_metrics_interval};
+    scitokens_xrootd::KeyRefresher m_keys;
+    scitokens_xrootd::AuditLog m_audit;
+    long m_verify_threads{0};
+    long m_verify_queue{0};
+    std::atomic<uint64_t> m_verify_timeout_ms{0};
+    // Last, so its threads stop before anything they use is destroyed.
+    std::unique_ptr<scitokens_xrootd::WorkerPool> m_verify_pool;
 
     static constexpr uint64_t m_expiry_secs = 60;
+    static constexpr long m_maintenance_tick_ms = 100;
+    // Per shard; a backlog beyond this carries over to the next tick, and
+    // expired entries are never served in the meantime.
+    static constexpr size_t m_expire_per_tick = 256;
+    static constexpr unsigned m_cache_shards = 64;
+    static constexpr long m_default_cache_max_entries = 100000;
+    static constexpr long m_default_cache_max_bytes = 256 * 1024 * 1024;
+    // 32 MiB of slots.
+    static constexpr long m_default_shared_cache_entries = 16384;
+    static constexpr size_t m_negative_cache_entries = 16384;
+    static constexpr uint64_t m_negative_cache_secs = 30;
+    static constexpr size_t m_chain_cache_entries = 16384;
+    static constexpr long m_default_chain_cache_lifetime = 0;
+    static constexpr long m_default_verify_threads = 8;
+    static constexpr long m_default_verify_queue = 256;
+    static constexpr long m_default_verify_timeout_ms = 5000;
+    static constexpr long m_default_audit_max_bytes = 256 * 1024 * 1024;
+    static constexpr long m_default_audit_max_files = 4;
+    static constexpr long m_default_metrics_interval = 60;
+    // Shorter than the 10 minutes after which scitokens-cpp itself would
+    // refetch cached keys on the request thread.
+    static constexpr long m_default_key_refresh_interval = 300;
 };
 
+// Passed by reference to std::chrono, so it needs a definition before C++17.
+constexpr long XrdAccSciTokens::m_maintenance_tick_ms;
+
 extern "C" {
 
 XrdAccAuthorize *XrdAccAuthorizeObject(XrdSysLogger *lp,
@@ -0,0 +1,352 @@
+
+#include "scitokens_audit.hh"
+#include "scitokens_metrics.hh"
+#include "scitokens_rules.hh"
+
+#include "XrdSys/XrdSysError.hh"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+
+using namespace scitokens_xrootd;
+
+namespace {
+
+const char *g_operations[] = {"any", "chmod", "chown", "create", "delete", "insert", "lock", "mkdir", "read",
+                              "readdir", "rename", "stat", "update"};
+
+// Copy `value` into the fixed-size field `dest`; returns false if it had to
+// be truncated.
+bool copy_field(char *dest, size_t size, const char *value, size_t length)
+{
+    bool fits = length < size;
+    if (!fits) {length = size - 1;}
+    memcpy(dest, value, length);
+    dest[length] = '\0';
+    return fits;
+}
+
+void append_json_string(std::string &out, const char *value)
+{
+    out.push_back('"');
+    for (const char *ptr = value; *ptr; ptr++) {
+        unsigned char c = *ptr;
+        if (c == '"' || c == '\\') {
+            out.push_back('\\');
+            out.push_back(c);
+        } else if (c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out.push_back(c);
+        }
+    }
+    out.push_back('"');
+}
+
+}
+
+
+constexpr size_t AuditIdentity::m_issuer_max;
+constexpr size_t AuditIdentity::m_subject_max;
+constexpr size_t AuditLog::m_slot_count;
+constexpr long AuditLog::m_drain_interval_ms;
+
+
+void
+AuditIdentity::set_issued_to(const std::string *issuer, const std::string *subject)
+{
+    m_issued = true;
+    bool fits = copy_field(m_issuer, m_issuer_max, issuer ? issuer->c_str() : "", issuer ? issuer->size() : 0);
+    fits = copy_field(m_subject, m_subject_max, subject ? subject->c_str() : "", subject ? subject->size() : 0) &&
+        fits;
+    if (!fits) {m_truncated = true;}
+}
+
+
+AuditLog::AuditLog(XrdSysError &log, Metrics &metrics)
+    : m_log(log),
+      m_metrics(metrics)
+{}
+
+
+AuditLog::~AuditLog()
+{
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_shutdown = true;
+    }
+    m_cv.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+
+void
+AuditLog::configure(const std::string &path, double sample_rate, uint64_t max_bytes, unsigned max_files)
+{
+    // The ring is only allocated once the log is first enabled.
+    if (!path.empty() && !m_slots) {
+        m_slots.reset(new Slot[m_slot_count]);
+        for (size_t idx = 0; idx < m_slot_count; idx++) {
+            m_slots[idx].m_sequence.store(idx, std::memory_order_relaxed);
+        }
+    }
+    uint64_t threshold = 0;
+    if (!path.empty() && sample_rate >= 1) {
+        threshold = UINT64_MAX;
+    } else if (!path.empty() && sample_rate > 0) {
+        threshold = static_cast<uint64_t>(sample_rate * 18446744073709551616.0);
+    }
+    // Requests stop appending before the file is closed.
+    if (!threshold) {m_threshold.store(0, std::memory_order_release);}
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        if (path != m_path) {
+            m_path = path;
+            m_reopen = true;
+        }
+        m_max_bytes = max_bytes;
+        m_max_files = max_files;
+        m_open_failed = false;
+    }
+    if (!path.empty() && !m_thread.joinable()) {
+        m_thread = std::thread(&AuditLog::run, this);
+    }
+    m_cv.notify_all();
+    // Published after the ring, which sample() callers go on to use.
+    if (threshold) {m_threshold.store(threshold, std::memory_order_release);}
+}
+
+
+uint64_t
+AuditLog::next_random()
+{
+    // xorshift64*, seeded differently on every thread.
+    static thread_local uint64_t state = 0;
+    if (!state) {
+        state = reinterpret_cast<uintptr_t>(&state) ^
+            static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+        if (!state) {state = 1;}
+    }
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1DULL;
+}
+
+
+void
+AuditLog::append(const AuditIdentity &identity, const char *path, Access_Operation oper, XrdAccPrivs privs,
+                 uint64_t latency_ns, bool reported)
+{
+    uint64_t pos = m_tail.load(std::memory_order_relaxed);
+    Slot *slot;
+    while (true) {
+        slot = &m_slots[pos & (m_slot_count - 1)];
+        auto sequence = slot->m_sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<int64_t>(sequence - pos);
+        if (!diff) {
+            if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {break;}
+        } else if (diff < 0) {
+            // The writer has not yet drained the slot from the last lap.
+            m_metrics.increment(Counter::AuditDropped);
+            return;
+        } else {
+            pos = m_tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    auto &record = slot->m_record;
+    record.m_time_ms = wall_time_ms();
+    record.m_latency_ns = latency_ns;
+    record.m_digest = identity.m_digest;
+    record.m_privs = privs;
+    record.m_oper = oper;
+    record.m_flags = (identity.m_token ? Token : 0) | (reported ? Reported : 0);
+    bool fits = copy_field(record.m_path, m_path_max, path ? path : "", path ? strlen(path) : 0) &&
+        !identity.m_truncated;
+    // The identity's fields are as large as the record's, so never truncated again.
+    memcpy(record.m_issuer, identity.m_issuer, strlen(identity.m_issuer) + 1);
+    if (identity.m_issued) {
+        memcpy(record.m_subject, identity.m_subject, strlen(identity.m_subject) + 1);
+    } else {
+        const char *user = identity.m_user ? identity.m_user : "";
+        fits = copy_field(record.m_subject, m_subject_max, user, strlen(user)) && fits;
+    }
+    if (!fits) {record.m_flags |= Truncated;}
+    slot->m_sequence.store(pos + 1, std::memory_order_release);
+}
+
+
+void
+AuditLog::format(const Record &record, std::string &out)
+{
+    char number[32];
+    out += "{\"time_ms\": ";
+    snprintf(number, sizeof(number), "%" PRId64, record.m_time_ms);
+    out += number;
+    if (record.m_flags & Token) {
+        // Enough of the token's SHA-256 to tell tokens apart, without
+        // making the log a source of tokens.
+        snprintf(number, sizeof(number), "%016" PRIx64, record.m_digest);
+        out += ", \"token\": \"";
+        out += number;
+        out += "\"";
+        if (record.m_issuer[0]) {
+            out += ", \"issuer\": ";
+            append_json_string(out, record.m_issuer);
+        }
+        if (record.m_subject[0]) {
+            out += ", \"subject\": ";
+            append_json_string(out, record.m_subject);
+        }
+    } else if (record.m_subject[0]) {
+        out += ", \"user\": ";
+        append_json_string(out, record.m_subject);
+    }
+    out += ", \"path\": ";
+    append_json_string(out, record.m_path);
+    out += ", \"oper\": ";
+    if (record.m_oper < sizeof(g_operations) / sizeof(g_operations[0])) {
+        out += "\"";
+        out += g_operations[record.m_oper];
+        out += "\"";
+    } else {
+        out += std::to_string(record.m_oper);
+    }
+    if (record.m_flags & Reported) {
+        out += ", \"accok\": ";
+        out += std::to_string(record.m_privs);
+    } else {
+        out += ", \"privs\": ";
+        out += std::to_string(record.m_privs);
+        out += ", \"latency_ns\": ";
+        out += std::to_string(record.m_latency_ns);
+    }
+    if (record.m_flags & Truncated) {
+        out += ", \"truncated\": true";
+    }
+    out += "}\n";
+}
+
+
+void
+AuditLog::run()
+{
+    std::string buffer;
+    std::unique_lock<std::mutex> guard(m_mutex);
+    while (true) {
+        m_cv.wait_for(guard, std::chrono::milliseconds(m_drain_interval_ms), [&]{return m_shutdown || m_reopen;});
+        if (m_reopen) {
+            // Records appended before the change go to the new file.
+            if (m_fd >= 0) {close(m_fd);}
+            m_fd = -1;
+            m_reopen = false;
+        }
+        drain(buffer);
+        if (m_shutdown) {break;}
+    }
+}
+
+
+void
+AuditLog::drain(std::string &buffer)
+{
+    if (m_fd < 0 && !m_open_failed && !m_path.empty()) {
+        open_file();
+    }
+    size_t count = 0;
+    buffer.clear();
+    while (true) {
+        auto &slot = m_slots[m_head & (m_slot_count - 1)];
+        if (slot.m_sequence.load(std::memory_order_acquire) != m_head + 1) {break;}
+        if (m_fd >= 0) {
+            format(slot.m_record, buffer);
+            count++;
+        } else {
+            m_metrics.increment(Counter::AuditDropped);
+        }
+        slot.m_sequence.store(m_head + m_slot_count, std::memory_order_release);
+        m_head++;
+        if (buffer.size() >= m_write_bytes) {
+            write(buffer, count);
+            count = 0;
+        }
+    }
+    write(buffer, count);
+}
+
+
+void
+AuditLog::write(std::string &buffer, size_t count)
+{
+    if (buffer.empty()) {return;}
+    size_t offset = 0;
+    while (offset < buffer.size()) {
+        auto written = ::write(m_fd, buffer.data() + offset, buffer.size() - offset);
+        if (written < 0 && errno == EINTR) {continue;}
+        if (written <= 0) {
+            m_log.Emsg("Audit", "Unable to write audit file", m_path.c_str(), strerror(errno));
+            m_metrics.increment(Counter::AuditDropped, count);
+            close(m_fd);
+            m_fd = -1;
+            m_open_failed = true;
+            buffer.clear();
+            return;
+        }
+        offset += written;
+    }
+    m_metrics.increment(Counter::AuditWritten, count);
+    m_file_bytes += buffer.size();
+    buffer.clear();
+    if (m_max_bytes && m_file_bytes >= m_max_bytes) {
+        rotate();
+    }
+}
+
+
+void
+AuditLog::open_file()
+{
+    m_fd = open(m_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    struct stat st;
+    if (m_fd < 0 || fstat(m_fd, &st)) {
+        m_log.Emsg("Audit", "Unable to open audit file", m_path.c_str(), strerror(errno));
+        if (m_fd >= 0) {close(m_fd);}
+        m_fd = -1;
+        m_open_failed = true;
+        return;
+    }
+    m_file_bytes = st.st_size;
+}
+
+
+void
+AuditLog::rotate()
+{
+    close(m_fd);
+    m_fd = -1;
+    // path.1 is the most recent of the old files.
+    if (m_max_files) {
+        for (unsigned idx = m_max_files - 1; idx > 0; idx--) {
+            rename((m_path + "." + std::to_string(idx)).c_str(), (m_path + "." + std::to_string(idx + 1)).c_str());
+        }
+        rename(m_path.c_str(), (m_path + ".1").c_str());
+    } else {
+        unlink(m_path.c_str());
+    }
+    open_file();
+}
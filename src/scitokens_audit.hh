@@ -0,0 +1,162 @@
+#ifndef __SCITOKENS_AUDIT_HH
+#define __SCITOKENS_AUDIT_HH
+
+#include "XrdAcc/XrdAccAuthorize.hh"
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class XrdSysError;
+
+namespace scitokens_xrootd {
+
+class Metrics;
+
+// Who an authorization decision was made for, filled in as the request is
+// resolved.  The issuer and subject are copied while the cached rules they
+// come from are still protected by the cache's epoch guard, so recording
+// them takes no reference on the rules' strings.
+struct AuditIdentity
+{
+    AuditIdentity() {m_issuer[0] = m_subject[0] = '\0';}
+
+    // Copy the issuer and subject of the rules that decided the request,
+    // truncating them to their fields; either may be null.
+    void set_issued_to(const std::string *issuer, const std::string *subject);
+
+    static constexpr size_t m_issuer_max = 128;
+    static constexpr size_t m_subject_max = 128;
+
+    bool m_token{false};
+    // Whether set_issued_to() was called.
+    bool m_issued{false};
+    bool m_truncated{false};
+    // The first word of the token's TokenDigest.
+    uint64_t m_digest{0};
+    char m_issuer[m_issuer_max];
+    char m_subject[m_subject_max];
+    // The XRootD user, for decisions made without a token.
+    const char *m_user{nullptr};
+};
+
+// A sampled trail of authorization decisions, written as JSON lines.
+//
+// Request threads append fixed-size records to a bounded ring without taking
+// a lock or allocating: a record claims a slot by advancing the tail with a
+// compare-and-swap and publishes it through the slot's sequence number, as in
+// Vyukov's bounded queue.  A single writer thread drains the ring every few
+// milliseconds, formats the records in one batch and appends them to the
+// file, which is rotated when it grows past a limit.  When the writer falls
+// behind and the ring is full, records are dropped and counted rather than
+// making the request wait.  Strings longer than their field are truncated.
+class AuditLog
+{
+public:
+    AuditLog(XrdSysError &log, Metrics &metrics);
+
+    // Writes out the records already appended.
+    ~AuditLog();
+
+    AuditLog(const AuditLog &) = delete;
+    AuditLog &operator=(const AuditLog &) = delete;
+
+    // Record a fraction `sample_rate` of decisions to `path`, keeping up to
+    // `max_files` rotated files of `max_bytes` each; an empty path stops
+    // recording.  A `max_bytes` of 0 disables rotation.  Not thread-safe:
+    // called by the configuration only.
+    void configure(const std::string &path, double sample_rate, uint64_t max_bytes, unsigned max_files);
+
+    // Whether to record the next decision; a single load when the log is
+    // disabled.
+    bool sample() const
+    {
+        auto threshold = m_threshold.load(std::memory_order_acquire);
+        return threshold && (threshold == UINT64_MAX || next_random() < threshold);
+    }
+
+    // Append a decision to the ring; only valid once sample() has returned
+    // true.  `reported` marks outcomes reported through
+    // XrdAccAuthorize::Audit() rather than decided here, with `privs` holding
+    // its accok.
+    void append(const AuditIdentity &identity, const char *path, Access_Operation oper, XrdAccPrivs privs,
+                uint64_t latency_ns, bool reported = false);
+
+    static constexpr size_t m_slot_count = 16384;
+    static constexpr size_t m_path_max = 256;
+    static constexpr size_t m_issuer_max = AuditIdentity::m_issuer_max;
+    static constexpr size_t m_subject_max = AuditIdentity::m_subject_max;
+
+private:
+    struct Record
+    {
+        int64_t m_time_ms;
+        uint64_t m_latency_ns;
+        uint64_t m_digest;
+        uint32_t m_privs;
+        uint8_t m_oper;
+        uint8_t m_flags;
+        char m_path[m_path_max];
+        char m_issuer[m_issuer_max];
+        char m_subject[m_subject_max];
+    };
+
+    enum Flags : uint8_t
+    {
+        Token = 1,
+        Truncated = 2,
+        Reported = 4,
+    };
+
+    struct Slot
+    {
+        // pos while free for the append at pos, pos + 1 once that append is
+        // published, and pos + m_slot_count when drained again.
+        std::atomic<uint64_t> m_sequence;
+        Record m_record;
+    };
+
+    static uint64_t next_random();
+    static void format(const Record &record, std::string &out);
+
+    void run();
+    void drain(std::string &buffer);
+    void write(std::string &buffer, size_t count);
+    void open_file();
+    void rotate();
+
+    XrdSysError &m_log;
+    Metrics &m_metrics;
+    std::atomic<uint64_t> m_threshold{0};
+    std::unique_ptr<Slot[]> m_slots;
+    std::atomic<uint64_t> m_tail{0};
+
+    // The writer's settings and state, guarded by m_mutex; only
+    // configure() ever waits on the writer.
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    uint64_t m_head{0};
+    std::string m_path;
+    uint64_t m_max_bytes{0};
+    unsigned m_max_files{0};
+    bool m_reopen{false};
+    bool m_shutdown{false};
+    int m_fd{-1};
+    // Not retried until the next configure(), so a bad path is logged once.
+    bool m_open_failed{false};
+    uint64_t m_file_bytes{0};
+    std::thread m_thread;
+
+    static constexpr long m_drain_interval_ms = 20;
+    // Formatted records are written out in chunks of about this size.
+    static constexpr size_t m_write_bytes = 1024 * 1024;
+};
+
+}
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef __SCITOKENS_BATCH_HH
+#define __SCITOKENS_BATCH_HH
+
+#include "XrdAcc/XrdAccAuthorize.hh"
+
+#include <stddef.h>
+
+class XrdOucEnv;
+class XrdSecEntity;
+
+// One (path, operation) pair of a batch authorization; m_privs receives the
+// result Access() would have returned for it.
+struct XrdAccBatchRequest
+{
+    const char *m_path;
+    Access_Operation m_oper;
+    XrdAccPrivs m_privs;
+};
+
+// Optional extension of XrdAccAuthorize for callers that check many paths
+// on behalf of the same client at once, such as a directory listing or a
+// bulk transfer.  The authorization credentials in `env` are resolved once
+// for the whole batch rather than once per path.
+class XrdAccBatchAuthorize
+{
+public:
+    virtual ~XrdAccBatchAuthorize() {}
+
+    virtual void AccessBatch(const XrdSecEntity *Entity, XrdAccBatchRequest *requests, size_t count,
+                             XrdOucEnv *env) = 0;
+};
+
+// Authorize `requests` with `authz`, in one call if it implements
+// XrdAccBatchAuthorize and with one Access() per request otherwise.
+inline void XrdAccAccessBatch(XrdAccAuthorize &authz, const XrdSecEntity *Entity,
+                              XrdAccBatchRequest *requests, size_t count, XrdOucEnv *env)
+{
+    if (auto batch = dynamic_cast<XrdAccBatchAuthorize *>(&authz)) {
+        batch->AccessBatch(Entity, requests, count, env);
+        return;
+    }
+    for (size_t idx = 0; idx < count; idx++) {
+        requests[idx].m_privs = authz.Access(Entity, requests[idx].m_path, requests[idx].m_oper, env);
+    }
+}
+
+#endif
@@ -0,0 +1,503 @@
+
+#include "scitokens_cache.hh"
+#include "scitokens_rules.hh"
+#include "scitokens_sha256.hh"
+
+#include <algorithm>
+#include <chrono>
+
+using namespace scitokens_xrootd;
+
+
+TokenDigest::TokenDigest(const char *authz, size_t len)
+{
+    static_assert(sizeof(m_words) == 32, "TokenDigest must hold a SHA-256 digest");
+    Sha256(authz, len, reinterpret_cast<unsigned char *>(m_words));
+}
+
+
+std::shared_ptr<XrdAccRules>
+TokenCache::Validation::wait()
+{
+    std::unique_lock<std::mutex> guard(m_mutex);
+    m_cv.wait(guard, [&]{return m_done;});
+    return m_rules;
+}
+
+
+bool
+TokenCache::Validation::wait_for(uint64_t timeout_ms, std::shared_ptr<XrdAccRules> &rules)
+{
+    std::unique_lock<std::mutex> guard(m_mutex);
+    if (!m_cv.wait_for(guard, std::chrono::milliseconds(timeout_ms), [&]{return m_done;})) {return false;}
+    rules = m_rules;
+    return true;
+}
+
+
+void
+TokenCache::Validation::finish(std::shared_ptr<XrdAccRules> rules)
+{
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_rules = std::move(rules);
+        m_done = true;
+    }
+    m_cv.notify_all();
+}
+
+
+TokenCache::Entry TokenCache::m_tombstone;
+
+
+TokenCache::Table::Table(size_t capacity)
+    : m_mask(capacity - 1),
+      m_slots(new std::atomic<Entry *>[capacity])
+{
+    for (size_t idx = 0; idx < capacity; idx++) {
+        m_slots[idx].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+
+TokenCache::Shard::~Shard()
+{
+    // The owning TokenCache is being destroyed, so no reader can remain.
+    auto table = m_table.load(std::memory_order_relaxed);
+    if (!table) {return;}
+    for (size_t idx = 0; idx <= table->m_mask; idx++) {
+        auto entry = table->m_slots[idx].load(std::memory_order_relaxed);
+        if (entry && entry != &m_tombstone) {delete entry;}
+    }
+    delete table;
+}
+
+
+const TokenCache::Entry *
+TokenCache::Shard::find(const TokenDigest &digest) const
+{
+    auto table = m_table.load(std::memory_order_acquire);
+    if (!table) {return nullptr;}
+    for (size_t idx = digest.m_words[0] & table->m_mask; ; idx = (idx + 1) & table->m_mask) {
+        auto entry = table->m_slots[idx].load(std::memory_order_acquire);
+        if (!entry) {return nullptr;}
+        if (entry != &m_tombstone && entry->m_digest == digest) {return entry;}
+    }
+}
+
+
+size_t
+TokenCache::Shard::find_slot(const TokenDigest &digest) const
+{
+    auto table = m_table.load(std::memory_order_relaxed);
+    if (!table) {return SIZE_MAX;}
+    for (size_t idx = digest.m_words[0] & table->m_mask; ; idx = (idx + 1) & table->m_mask) {
+        auto entry = table->m_slots[idx].load(std::memory_order_relaxed);
+        if (!entry) {return SIZE_MAX;}
+        if (entry != &m_tombstone && entry->m_digest == digest) {return idx;}
+    }
+}
+
+
+size_t
+TokenCache::Shard::expire(uint64_t now, size_t max_deadlines, EpochDomain &epochs)
+{
+    size_t removed = 0;
+    for (size_t examined = 0; examined < max_deadlines && !m_deadlines.empty() &&
+         now > m_deadlines.front().m_expiry; examined++)
+    {
+        std::pop_heap(m_deadlines.begin(), m_deadlines.end());
+        auto digest = m_deadlines.back().m_digest;
+        m_deadlines.pop_back();
+        // The entry may since have been evicted, or replaced by one that
+        // expires later and has its own deadline.
+        auto slot = find_slot(digest);
+        if (slot == SIZE_MAX) {continue;}
+        auto entry = m_table.load(std::memory_order_relaxed)->m_slots[slot].load(std::memory_order_relaxed);
+        if (now > entry->m_expiry) {
+            remove(slot, epochs);
+            removed++;
+        }
+    }
+    m_next_expiry.store(m_deadlines.empty() ? UINT64_MAX : m_deadlines.front().m_expiry,
+                        std::memory_order_relaxed);
+    // Give back the memory of a table that emptied out after a burst.
+    auto table = m_table.load(std::memory_order_relaxed);
+    if (removed && table->m_mask >= 64 && m_count * 8 < table->m_mask) {
+        rebuild(m_count, epochs);
+        compact_deadlines();
+    }
+    return removed;
+}
+
+
+void
+TokenCache::Shard::push_deadline(uint64_t expiry, const TokenDigest &digest)
+{
+    // Deadlines of evicted and replaced entries pile up between expiries;
+    // bound them to a constant factor of the live entries.
+    if (m_deadlines.size() >= 2 * m_count + 64) {compact_deadlines();}
+    m_deadlines.push_back(Deadline{expiry, digest});
+    std::push_heap(m_deadlines.begin(), m_deadlines.end());
+    m_next_expiry.store(m_deadlines.front().m_expiry, std::memory_order_relaxed);
+}
+
+
+void
+TokenCache::Shard::compact_deadlines()
+{
+    m_deadlines.clear();
+    auto table = m_table.load(std::memory_order_relaxed);
+    if (table) {
+        for (size_t idx = 0; idx <= table->m_mask; idx++) {
+            auto entry = table->m_slots[idx].load(std::memory_order_relaxed);
+            if (entry && entry != &m_tombstone) {
+                m_deadlines.push_back(Deadline{entry->m_expiry, entry->m_digest});
+            }
+        }
+    }
+    std::make_heap(m_deadlines.begin(), m_deadlines.end());
+    m_next_expiry.store(m_deadlines.empty() ? UINT64_MAX : m_deadlines.front().m_expiry,
+                        std::memory_order_relaxed);
+}
+
+
+void
+TokenCache::Shard::remove(size_t slot, EpochDomain &epochs)
+{
+    auto table = m_table.load(std::memory_order_relaxed);
+    auto entry = table->m_slots[slot].load(std::memory_order_relaxed);
+    table->m_slots[slot].store(&m_tombstone, std::memory_order_release);
+    m_bytes -= entry->m_bytes;
+    m_count--;
+    epochs.retire(entry);
+}
+
+
+void
+TokenCache::Shard::rebuild(size_t count, EpochDomain &epochs)
+{
+    // Start at most a quarter full so a run of inserts fits before the next
+    // rebuild.
+    size_t capacity = 8;
+    while (capacity < 4 * (count + 1)) {capacity <<= 1;}
+    std::unique_ptr<Table> fresh(new Table(capacity));
+    auto old = m_table.load(std::memory_order_relaxed);
+    if (old) {
+        for (size_t idx = 0; idx <= old->m_mask; idx++) {
+            auto entry = old->m_slots[idx].load(std::memory_order_relaxed);
+            if (!entry || entry == &m_tombstone) {continue;}
+            auto slot = entry->m_digest.m_words[0] & fresh->m_mask;
+            while (fresh->m_slots[slot].load(std::memory_order_relaxed)) {
+                slot = (slot + 1) & fresh->m_mask;
+            }
+            fresh->m_slots[slot].store(entry, std::memory_order_relaxed);
+        }
+    }
+    // Readers still walking the old table find the same entries there.
+    m_table.store(fresh.release(), std::memory_order_release);
+    m_used = m_count;
+    m_hand = 0;
+    if (old) {epochs.retire(old);}
+}
+
+
+void
+TokenCache::Shard::insert(const TokenDigest &digest, std::shared_ptr<XrdAccRules> rules, uint64_t expiry,
+                          uint64_t now, size_t max_entries, size_t max_bytes, EpochDomain &epochs)
+{
+    std::unique_ptr<Entry> entry(new Entry());
+    entry->m_digest = digest;
+    entry->m_expiry = expiry;
+    // Approximate footprint: the compiled rules, the entry, its deadline and
+    // its share of a table kept between a quarter and half full.
+    entry->m_bytes = rules->memory_usage() + sizeof(Entry) + sizeof(Deadline) + 4 * sizeof(void *);
+    entry->m_rules = std::move(rules);
+
+    auto table = m_table.load(std::memory_order_relaxed);
+    if (table) {
+        for (size_t idx = digest.m_words[0] & table->m_mask; ; idx = (idx + 1) & table->m_mask) {
+            auto existing = table->m_slots[idx].load(std::memory_order_relaxed);
+            if (!existing) {break;}
+            if (existing != &m_tombstone && existing->m_digest == digest) {
+                remove(idx, epochs);
+                break;
+            }
+        }
+    }
+    // Make room before inserting so the new entry is never the victim.
+    auto bytes = entry->m_bytes;
+    evict(now, max_entries ? max_entries - 1 : SIZE_MAX,
+          max_bytes ? (max_bytes > bytes ? max_bytes - bytes : 0) : SIZE_MAX, epochs);
+
+    table = m_table.load(std::memory_order_relaxed);
+    if (!table || (m_used + 1) * 2 > table->m_mask + 1) {
+        rebuild(m_count + 1, epochs);
+        table = m_table.load(std::memory_order_relaxed);
+    }
+    // Reuse the first tombstone on the probe path, if any.
+    auto slot = digest.m_words[0] & table->m_mask;
+    while (true) {
+        auto existing = table->m_slots[slot].load(std::memory_order_relaxed);
+        if (!existing) {
+            m_used++;
+            break;
+        }
+        if (existing == &m_tombstone) {break;}
+        slot = (slot + 1) & table->m_mask;
+    }
+    push_deadline(expiry, digest);
+    m_bytes += bytes;
+    m_count++;
+    table->m_slots[slot].store(entry.release(), std::memory_order_release);
+}
+
+
+void
+TokenCache::Shard::evict(uint64_t now, size_t max_entries, size_t max_bytes, EpochDomain &epochs)
+{
+    // Each full revolution clears every reference bit, so this terminates
+    // within two passes over the table.
+    while (m_count && (m_count > max_entries || m_bytes > max_bytes)) {
+        auto table = m_table.load(std::memory_order_relaxed);
+        auto entry = table->m_slots[m_hand].load(std::memory_order_relaxed);
+        if (entry && entry != &m_tombstone &&
+            (now > entry->m_expiry || !entry->m_referenced.exchange(false, std::memory_order_relaxed)))
+        {
+            remove(m_hand, epochs);
+        }
+        m_hand = (m_hand + 1) & table->m_mask;
+    }
+}
+
+
+TokenCache::TokenCache(unsigned shard_count)
+{
+    size_t count = 1;
+    while (count < shard_count) {count <<= 1;}
+    m_shard_mask = count - 1;
+    m_shards.reserve(count);
+    for (size_t idx = 0; idx < count; idx++) {
+        m_shards.emplace_back(new Shard());
+    }
+}
+
+
+TokenCache::~TokenCache()
+{}
+
+
+TokenCache::Shard &
+TokenCache::shard_for(const TokenDigest &digest) const
+{
+    // The first word is the probe start inside the shard's table; pick the
+    // shard with an independent word so the two do not correlate.
+    return *m_shards[digest.m_words[1] & m_shard_mask];
+}
+
+
+const XrdAccRules *
+TokenCache::get(const TokenDigest &digest, uint64_t now, const EpochDomain::Guard &) const
+{
+    auto entry = shard_for(digest).find(digest);
+    if (!entry || now > entry->m_expiry) {return nullptr;}
+    // Only write when the bit changes so hot entries stay read-only.
+    if (!entry->m_referenced.load(std::memory_order_relaxed)) {
+        entry->m_referenced.store(true, std::memory_order_relaxed);
+    }
+    return entry->m_rules.get();
+}
+
+
+std::shared_ptr<XrdAccRules>
+TokenCache::acquire(const TokenDigest &digest, uint64_t now,
+                    std::shared_ptr<Validation> &validation, bool &leader)
+{
+    auto &shard = shard_for(digest);
+    leader = false;
+    std::lock_guard<std::mutex> guard(shard.m_mutex);
+    auto entry = shard.find(digest);
+    if (entry && now <= entry->m_expiry) {
+        return entry->m_rules;
+    }
+    auto &inflight = shard.m_inflight[digest];
+    if (!inflight) {
+        inflight = std::make_shared<Validation>();
+        inflight->m_generation = m_generation.load(std::memory_order_acquire);
+        leader = true;
+    }
+    validation = inflight;
+    return nullptr;
+}
+
+
+void
+TokenCache::complete(const TokenDigest &digest, const std::shared_ptr<Validation> &validation,
+                     std::shared_ptr<XrdAccRules> rules, uint64_t expiry, uint64_t now)
+{
+    auto &shard = shard_for(digest);
+    try {
+        std::lock_guard<std::mutex> guard(shard.m_mutex);
+        auto iter = shard.m_inflight.find(digest);
+        if (iter != shard.m_inflight.end() && iter->second == validation) {
+            shard.m_inflight.erase(iter);
+        }
+        // A clear() since the validation began may have been for a new
+        // configuration, which the rules predate.
+        if (rules && expiry >= now && validation->m_generation == m_generation.load(std::memory_order_acquire)) {
+            shard.insert(digest, rules, expiry, now, m_shard_max_entries.load(std::memory_order_relaxed),
+                         m_shard_max_bytes.load(std::memory_order_relaxed), m_epochs);
+        }
+    } catch (...) {
+        // Never leave waiters hanging, even if the result could not be cached.
+        validation->finish(std::move(rules));
+        throw;
+    }
+    validation->finish(std::move(rules));
+}
+
+
+void
+TokenCache::insert(const TokenDigest &digest, std::shared_ptr<XrdAccRules> rules, uint64_t expiry,
+                   uint64_t now)
+{
+    auto &shard = shard_for(digest);
+    std::lock_guard<std::mutex> guard(shard.m_mutex);
+    shard.insert(digest, std::move(rules), expiry, now, m_shard_max_entries.load(std::memory_order_relaxed),
+                 m_shard_max_bytes.load(std::memory_order_relaxed), m_epochs);
+}
+
+
+std::vector<TokenCache::Item>
+TokenCache::items(uint64_t now) const
+{
+    std::vector<Item> result;
+    for (const auto &shard : m_shards) {
+        std::lock_guard<std::mutex> guard(shard->m_mutex);
+        auto table = shard->m_table.load(std::memory_order_relaxed);
+        if (!table) {continue;}
+        for (size_t idx = 0; idx <= table->m_mask; idx++) {
+            auto entry = table->m_slots[idx].load(std::memory_order_relaxed);
+            if (!entry || entry == &m_tombstone || now > entry->m_expiry) {continue;}
+            Item item;
+            item.m_digest = entry->m_digest;
+            item.m_rules = entry->m_rules;
+            item.m_expiry = entry->m_expiry;
+            result.push_back(std::move(item));
+        }
+    }
+    return result;
+}
+
+
+void
+TokenCache::clear()
+{
+    m_generation.fetch_add(1, std::memory_order_acq_rel);
+    for (const auto &shard : m_shards) {
+        std::lock_guard<std::mutex> guard(shard->m_mutex);
+        shard->m_inflight.clear();
+        auto table = shard->m_table.load(std::memory_order_relaxed);
+        if (!table) {continue;}
+        shard->m_table.store(nullptr, std::memory_order_release);
+        for (size_t idx = 0; idx <= table->m_mask; idx++) {
+            auto entry = table->m_slots[idx].load(std::memory_order_relaxed);
+            if (entry && entry != &m_tombstone) {m_epochs.retire(entry);}
+        }
+        m_epochs.retire(table);
+        shard->m_count = 0;
+        shard->m_used = 0;
+        shard->m_hand = 0;
+        shard->m_bytes = 0;
+        shard->m_deadlines.clear();
+        shard->m_next_expiry.store(UINT64_MAX, std::memory_order_relaxed);
+    }
+}
+
+
+void
+TokenCache::set_limits(size_t max_entries, size_t max_bytes)
+{
+    // Round up so a small non-zero limit never becomes "unlimited".
+    auto count = m_shards.size();
+    m_shard_max_entries = max_entries ? (max_entries + count - 1) / count : 0;
+    m_shard_max_bytes = max_bytes ? (max_bytes + count - 1) / count : 0;
+}
+
+
+size_t
+TokenCache::expire_shard(size_t idx, uint64_t now, size_t max_deadlines)
+{
+    auto &shard = *m_shards[idx];
+    // Most ticks find nothing due in most shards.
+    if (now <= shard.m_next_expiry.load(std::memory_order_relaxed)) {return 0;}
+    std::lock_guard<std::mutex> guard(shard.m_mutex);
+    return shard.expire(now, max_deadlines, m_epochs);
+}
+
+
+size_t
+TokenCache::expire(uint64_t now, size_t max_deadlines)
+{
+    size_t removed = 0;
+    for (size_t idx = 0; idx < m_shards.size(); idx++) {
+        removed += expire_shard(idx, now, max_deadlines);
+    }
+    // Readers never reclaim, so the sweep also frees what they have left.
+    m_epochs.reclaim();
+    return removed;
+}
+
+
+size_t
+TokenCache::size() const
+{
+    size_t result = 0;
+    for (const auto &shard : m_shards) {
+        std::lock_guard<std::mutex> guard(shard->m_mutex);
+        result += shard->m_count;
+    }
+    return result;
+}
+
+
+size_t
+TokenCache::bytes() const
+{
+    size_t result = 0;
+    for (const auto &shard : m_shards) {
+        std::lock_guard<std::mutex> guard(shard->m_mutex);
+        result += shard->m_bytes;
+    }
+    return result;
+}
+
+
+NegativeCache::NegativeCache(unsigned shard_count, size_t max_entries, uint64_t ttl_secs,
+                             uint64_t log_interval_secs)
+    : m_ttl_secs(ttl_secs),
+      m_log_interval_secs(log_interval_secs),
+      m_entries(shard_count, max_entries)
+{}
+
+
+bool
+NegativeCache::contains(const TokenDigest &digest, uint64_t now, uint64_t &repeats)
+{
+    repeats = 0;
+    return m_entries.modify(digest, now, [&](Rejection &rejection) {
+        rejection.m_repeats++;
+        if (now >= rejection.m_next_log) {
+            repeats = rejection.m_repeats;
+            rejection.m_repeats = 0;
+            rejection.m_next_log = now + m_log_interval_secs;
+        }
+    });
+}
+
+
+void
+NegativeCache::insert(const TokenDigest &digest, uint64_t generation, uint64_t now)
+{
+    m_entries.insert(digest, generation, now + m_ttl_secs, Rejection{now + m_log_interval_secs, 0});
+}
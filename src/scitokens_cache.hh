@@ -0,0 +1,476 @@
+#ifndef __SCITOKENS_CACHE_HH
+#define __SCITOKENS_CACHE_HH
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "scitokens_epoch.hh"
+
+class XrdAccRules;
+
+namespace scitokens_xrootd {
+
+// SHA-256 of the full authorization string.  Cache keys are fixed-size
+// regardless of the token length, and since the digest is uniformly
+// distributed its words double as hash values.
+struct TokenDigest
+{
+    TokenDigest() {}
+    TokenDigest(const char *authz, size_t len);
+
+    bool operator==(const TokenDigest &other) const {
+        return m_words[0] == other.m_words[0] && m_words[1] == other.m_words[1] &&
+            m_words[2] == other.m_words[2] && m_words[3] == other.m_words[3];
+    }
+
+    uint64_t m_words[4]{0, 0, 0, 0};
+};
+
+struct TokenDigestHash
+{
+    size_t operator()(const TokenDigest &digest) const {return digest.m_words[0];}
+};
+
+// A concurrent map from the digest of a bearer token to its compiled ACLs.
+//
+// The cache is split into a power-of-two number of shards selected by a hash
+// of the token.  Each shard is an open-addressing table of pointers to
+// immutable entries: lookups take no lock and write no shared memory, only
+// the calling thread's epoch record (see EpochDomain).  Writers serialize on
+// a per-shard mutex, publish entries with release stores and hand unlinked
+// entries and outgrown tables to the epoch domain for deferred deletion.
+// Expired entries are never returned.  Each shard also keeps a min-heap of
+// its entries' deadlines, so the owner can remove them close to their real
+// expiry by calling expire() from a maintenance thread: the work per call is
+// proportional to the number of entries that are due (and bounded by the
+// caller), not to the size of the cache.  Times are in the milliseconds of
+// monotonic_time_ms().
+//
+// The cache is bounded by an entry count and an estimate of the memory held by
+// the entries, both split evenly across the shards.  When an insert pushes a
+// shard over either limit, entries are first evicted with the CLOCK
+// algorithm: a hit sets the entry's reference bit, and the shard's clock hand
+// evicts the first entry it finds that is expired or has not been referenced
+// since the hand last passed it.
+//
+// Misses are de-duplicated: the first thread to miss on a token becomes the
+// leader of a Validation and every other thread missing on the same token
+// waits for the leader's result instead of repeating the verification.
+// clear() starts a new generation: validations begun before it are
+// abandoned, so later misses start afresh, and their results are handed to
+// their waiters but never cached.
+class TokenCache
+{
+public:
+    // A token validation in progress.
+    class Validation
+    {
+    public:
+        // Block until the leader completes; returns nullptr if it failed.
+        std::shared_ptr<XrdAccRules> wait();
+
+        // As wait(), but for at most `timeout_ms` milliseconds; returns false
+        // if the leader had not completed by then.
+        bool wait_for(uint64_t timeout_ms, std::shared_ptr<XrdAccRules> &rules);
+
+    private:
+        friend class TokenCache;
+
+        void finish(std::shared_ptr<XrdAccRules> rules);
+
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        bool m_done{false};
+        std::shared_ptr<XrdAccRules> m_rules;
+        // Of the cache when the validation began.
+        uint64_t m_generation{0};
+    };
+
+    // A cached entry, as returned by items().
+    struct Item
+    {
+        TokenDigest m_digest;
+        std::shared_ptr<XrdAccRules> m_rules;
+        uint64_t m_expiry;
+    };
+
+    explicit TokenCache(unsigned shard_count);
+    ~TokenCache();
+
+    TokenCache(const TokenCache &) = delete;
+    TokenCache &operator=(const TokenCache &) = delete;
+
+    // Lookups must be made inside a Guard on this domain.
+    EpochDomain &epochs() const {return m_epochs;}
+
+    // Returns the cached rules for `digest`, or nullptr if the token is not
+    // present or its entry has expired as of `now`.  The rules remain valid
+    // until `guard` is destroyed.
+    const XrdAccRules *get(const TokenDigest &digest, uint64_t now, const EpochDomain::Guard &guard) const;
+
+    // Called after a miss.  Returns the cached rules if another thread
+    // populated the entry in the meantime.  Otherwise `validation` is set to
+    // the in-flight validation for `digest`; `leader` is set if the caller
+    // created it and must call complete(), else the caller should wait() on it.
+    std::shared_ptr<XrdAccRules> acquire(const TokenDigest &digest, uint64_t now,
+                                         std::shared_ptr<Validation> &validation,
+                                         bool &leader);
+
+    // Publish the leader's result, waking all waiters.  On success (non-null
+    // `rules`), the entry is cached until the monotonic time `expiry`,
+    // evicting other entries of its shard if it is over its limits; it is
+    // not cached at all if `expiry` is already in the past, or if the cache
+    // was cleared since the validation began.
+    void complete(const TokenDigest &digest, const std::shared_ptr<Validation> &validation,
+                  std::shared_ptr<XrdAccRules> rules, uint64_t expiry, uint64_t now);
+
+    // Cache `rules` for `digest` until the monotonic time `expiry`, outside
+    // of any validation; used to restore entries saved by a previous process.
+    void insert(const TokenDigest &digest, std::shared_ptr<XrdAccRules> rules, uint64_t expiry,
+                uint64_t now);
+
+    // Returns all entries still valid as of `now`, locking one shard at a time.
+    std::vector<Item> items(uint64_t now) const;
+
+    // Drop every entry and abandon the validations in flight; they still
+    // complete, but only for the threads already waiting on them.
+    void clear();
+
+    // Bound the cache to `max_entries` entries and roughly `max_bytes` of
+    // memory; zero means unlimited.  Takes effect on the next insert into
+    // each shard.
+    void set_limits(size_t max_entries, size_t max_bytes);
+
+    // Drop the entries of shard `idx` which have expired as of `now`,
+    // examining at most `max_deadlines` deadlines; returns the count removed.
+    // Takes no lock unless the shard's earliest deadline has passed.
+    size_t expire_shard(size_t idx, uint64_t now, size_t max_deadlines = SIZE_MAX);
+
+    // expire_shard() for every shard, then free what the removals and
+    // earlier writes retired; returns the count removed.
+    size_t expire(uint64_t now, size_t max_deadlines = SIZE_MAX);
+
+    size_t shard_count() const {return m_shards.size();}
+
+    size_t size() const;
+    size_t bytes() const;
+
+private:
+    // Never modified once published, except for the reference bit.
+    struct Entry
+    {
+        TokenDigest m_digest;
+        std::shared_ptr<XrdAccRules> m_rules;
+        uint64_t m_expiry{0};
+        size_t m_bytes{0};
+        // Set by lock-free readers, only when not already set.
+        mutable std::atomic<bool> m_referenced{false};
+    };
+
+    // Linear probing over a power-of-two number of slots, each empty
+    // (nullptr), a tombstone left by a removal, or an entry.  Kept at most
+    // half full, counting tombstones, so every probe sequence ends.
+    struct Table
+    {
+        explicit Table(size_t capacity);
+
+        const size_t m_mask;
+        std::unique_ptr<std::atomic<Entry *>[]> m_slots;
+    };
+
+    // An entry's expiry as pushed onto its shard's heap.  Left in place when
+    // the entry is evicted or replaced and discarded once it surfaces.
+    struct Deadline
+    {
+        uint64_t m_expiry;
+        TokenDigest m_digest;
+
+        // Orders the heap with the earliest deadline on top.
+        bool operator<(const Deadline &other) const {return m_expiry > other.m_expiry;}
+    };
+
+    // All members except m_table and m_next_expiry are protected by m_mutex.
+    struct Shard
+    {
+        ~Shard();
+
+        const Entry *find(const TokenDigest &digest) const;
+        // The slot holding `digest`, or SIZE_MAX.
+        size_t find_slot(const TokenDigest &digest) const;
+
+        size_t expire(uint64_t now, size_t max_deadlines, EpochDomain &epochs);
+        void push_deadline(uint64_t expiry, const TokenDigest &digest);
+        // Rebuild the heap from the live entries, dropping stale deadlines.
+        void compact_deadlines();
+        void insert(const TokenDigest &digest, std::shared_ptr<XrdAccRules> rules, uint64_t expiry,
+                    uint64_t now, size_t max_entries, size_t max_bytes, EpochDomain &epochs);
+        void remove(size_t slot, EpochDomain &epochs);
+        // Evict until the shard holds at most `max_entries` and `max_bytes`.
+        void evict(uint64_t now, size_t max_entries, size_t max_bytes, EpochDomain &epochs);
+        // Move the entries into a fresh table sized for `count` of them,
+        // dropping the tombstones.
+        void rebuild(size_t count, EpochDomain &epochs);
+
+        mutable std::mutex m_mutex;
+        std::atomic<Table *> m_table{nullptr};
+        size_t m_count{0};
+        // Entries plus tombstones.
+        size_t m_used{0};
+        size_t m_hand{0};
+        size_t m_bytes{0};
+        std::vector<Deadline> m_deadlines;
+        // The top of m_deadlines, readable without the lock.
+        std::atomic<uint64_t> m_next_expiry{UINT64_MAX};
+        std::unordered_map<TokenDigest, std::shared_ptr<Validation>, TokenDigestHash> m_inflight;
+    };
+
+    Shard &shard_for(const TokenDigest &digest) const;
+
+    // Marks a removed slot; its address is all that matters.
+    static Entry m_tombstone;
+
+    // Declared before the shards so it outlives them.
+    mutable EpochDomain m_epochs;
+    size_t m_shard_mask{0};
+    std::vector<std::unique_ptr<Shard>> m_shards;
+    std::atomic<size_t> m_shard_max_entries{0};
+    std::atomic<size_t> m_shard_max_bytes{0};
+    // Bumped by clear() before it takes any shard lock; read under one.
+    std::atomic<uint64_t> m_generation{0};
+};
+
+
+// Picks the shard of a TokenDigest from a different word than
+// TokenDigestHash, so a shard's keys still spread over its map's buckets.
+struct TokenDigestShardHash
+{
+    size_t operator()(const TokenDigest &digest) const {return digest.m_words[1];}
+};
+
+
+// A small sharded map for caches whose entries live until a deadline chosen
+// by the caller, in whatever clock units it uses.  Each shard holds at most
+// its share of `max_entries`; when full, the oldest insertion is evicted
+// (FIFO over a ring of slots).  clear() drops every entry and starts a new
+// generation; a value computed under an older generation is discarded by
+// insert(), so nothing looked up while the cache was being cleared is kept.
+// `ShardHash` selects the shard and `Hash` the bucket within it.
+template<typename Key, typename Value, typename Hash, typename ShardHash>
+class FifoCache
+{
+public:
+    FifoCache(unsigned shard_count, size_t max_entries);
+
+    FifoCache(const FifoCache &) = delete;
+    FifoCache &operator=(const FifoCache &) = delete;
+
+    // Returns true and sets `value` if `key` has an entry valid at `now`.
+    bool get(const Key &key, uint64_t now, Value &value)
+    {
+        return modify(key, now, [&](Value &entry) {value = entry;});
+    }
+
+    // Returns true and calls `function` on the value under the shard lock if
+    // `key` has an entry valid at `now`.
+    template<typename Function>
+    bool modify(const Key &key, uint64_t now, Function function);
+
+    // To be read before computing a value and passed to insert().
+    uint64_t generation() const {return m_generation.load(std::memory_order_acquire);}
+
+    // Record `value` for `key` until `expiry`, unless the cache was cleared
+    // since `generation` was read.
+    void insert(const Key &key, uint64_t generation, uint64_t expiry, const Value &value);
+
+    void clear();
+
+    size_t size() const;
+
+private:
+    struct Entry
+    {
+        uint64_t m_expiry{0};
+        Value m_value{};
+        size_t m_slot{0};
+    };
+
+    struct Shard
+    {
+        mutable std::mutex m_mutex;
+        std::unordered_map<Key, Entry, Hash> m_map;
+        std::vector<Key> m_ring;
+        size_t m_next_slot{0};
+    };
+
+    Shard &shard_for(const Key &key) const {return *m_shards[ShardHash()(key) & m_shard_mask];}
+
+    const size_t m_shard_capacity;
+    std::atomic<uint64_t> m_generation{0};
+    size_t m_shard_mask{0};
+    std::vector<std::unique_ptr<Shard>> m_shards;
+};
+
+
+// Remembers recently rejected tokens so repeated presentations of the same
+// bad token cost a hash lookup instead of another parse and verification.
+//
+// Entries live for a fixed TTL in a FifoCache.  Repeat presentations are
+// counted so callers can log a periodic summary instead of one message per
+// attempt.
+class NegativeCache
+{
+public:
+    NegativeCache(unsigned shard_count, size_t max_entries, uint64_t ttl_secs,
+                  uint64_t log_interval_secs);
+
+    NegativeCache(const NegativeCache &) = delete;
+    NegativeCache &operator=(const NegativeCache &) = delete;
+
+    // Returns true if `digest` was rejected within the TTL.  When a summary of
+    // the repeats is due, `repeats` is set to the number of attempts since the
+    // previous summary (or since the rejection); otherwise it is set to 0.
+    bool contains(const TokenDigest &digest, uint64_t now, uint64_t &repeats);
+
+    // To be read before validating the token and passed to insert().
+    uint64_t generation() const {return m_entries.generation();}
+
+    // Record that `digest` was rejected at `now`, unless the cache was
+    // cleared since `generation` was read.
+    void insert(const TokenDigest &digest, uint64_t generation, uint64_t now);
+
+    void clear() {m_entries.clear();}
+
+    size_t size() const {return m_entries.size();}
+
+private:
+    struct Rejection
+    {
+        uint64_t m_next_log;
+        uint64_t m_repeats;
+    };
+
+    const uint64_t m_ttl_secs;
+    const uint64_t m_log_interval_secs;
+    FifoCache<TokenDigest, Rejection, TokenDigestHash, TokenDigestShardHash> m_entries;
+};
+
+
+// Remembers the decisions of the chained authorizer for a short time, so
+// requests it handles (those without a token, or whose token grants nothing
+// for the path) do not repeat its lookups on every call.  Keys are digests
+// of everything the decision depends on, built by the caller; values are the
+// XrdAccPrivs it returned, valid until a deadline in the milliseconds of
+// monotonic_time_ms().
+typedef FifoCache<TokenDigest, int, TokenDigestHash, TokenDigestShardHash> ChainCache;
+
+
+template<typename Key, typename Value, typename Hash, typename ShardHash>
+FifoCache<Key, Value, Hash, ShardHash>::FifoCache(unsigned shard_count, size_t max_entries)
+    : m_shard_capacity(std::max<size_t>(1, max_entries / std::max(1u, shard_count)))
+{
+    size_t count = 1;
+    while (count < shard_count) {count <<= 1;}
+    m_shard_mask = count - 1;
+    m_shards.reserve(count);
+    for (size_t idx = 0; idx < count; idx++) {
+        m_shards.emplace_back(new Shard());
+    }
+}
+
+
+template<typename Key, typename Value, typename Hash, typename ShardHash>
+template<typename Function>
+bool
+FifoCache<Key, Value, Hash, ShardHash>::modify(const Key &key, uint64_t now, Function function)
+{
+    auto &shard = shard_for(key);
+    std::lock_guard<std::mutex> guard(shard.m_mutex);
+    auto iter = shard.m_map.find(key);
+    if (iter == shard.m_map.end()) {return false;}
+    if (now > iter->second.m_expiry) {
+        // Leave the ring slot in place; it is reclaimed when the ring wraps.
+        shard.m_map.erase(iter);
+        return false;
+    }
+    function(iter->second.m_value);
+    return true;
+}
+
+
+template<typename Key, typename Value, typename Hash, typename ShardHash>
+void
+FifoCache<Key, Value, Hash, ShardHash>::insert(const Key &key, uint64_t generation, uint64_t expiry,
+                                               const Value &value)
+{
+    auto &shard = shard_for(key);
+    std::lock_guard<std::mutex> guard(shard.m_mutex);
+    // Read under the shard lock: clear() advances the generation before it
+    // empties the shards, so either this sees the new generation or clear()
+    // removes the entry afterwards.
+    if (generation != m_generation.load(std::memory_order_relaxed)) {return;}
+    auto iter = shard.m_map.find(key);
+    if (iter != shard.m_map.end()) {
+        iter->second.m_expiry = expiry;
+        iter->second.m_value = value;
+        return;
+    }
+
+    size_t slot;
+    if (shard.m_ring.size() < m_shard_capacity) {
+        slot = shard.m_ring.size();
+        shard.m_ring.push_back(key);
+    } else {
+        slot = shard.m_next_slot;
+        shard.m_next_slot = (slot + 1) % m_shard_capacity;
+        // Evict the previous occupant unless it was already dropped and
+        // re-inserted into a different slot.
+        auto old = shard.m_map.find(shard.m_ring[slot]);
+        if (old != shard.m_map.end() && old->second.m_slot == slot) {
+            shard.m_map.erase(old);
+        }
+        shard.m_ring[slot] = key;
+    }
+    auto &entry = shard.m_map[key];
+    entry.m_expiry = expiry;
+    entry.m_value = value;
+    entry.m_slot = slot;
+}
+
+
+template<typename Key, typename Value, typename Hash, typename ShardHash>
+void
+FifoCache<Key, Value, Hash, ShardHash>::clear()
+{
+    m_generation.fetch_add(1, std::memory_order_acq_rel);
+    for (auto &shard : m_shards) {
+        std::lock_guard<std::mutex> guard(shard->m_mutex);
+        shard->m_map.clear();
+        shard->m_ring.clear();
+        shard->m_next_slot = 0;
+    }
+}
+
+
+template<typename Key, typename Value, typename Hash, typename ShardHash>
+size_t
+FifoCache<Key, Value, Hash, ShardHash>::size() const
+{
+    size_t result = 0;
+    for (const auto &shard : m_shards) {
+        std::lock_guard<std::mutex> guard(shard->m_mutex);
+        result += shard->m_map.size();
+    }
+    return result;
+}
+
+}
+
+#endif
@@ -0,0 +1,188 @@
+
+#include "scitokens_cache_file.hh"
+#include "scitokens_cache.hh"
+#include "scitokens_rules.hh"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <stdexcept>
+
+using namespace scitokens_xrootd;
+
+namespace {
+
+const char g_magic[8] = {'X', 'S', 'T', 'C', 'A', 'C', 'H', 'E'};
+const uint32_t g_version = 4;
+
+// Followed by the entries, each laid out as an EntryHeader and the
+// serialized XrdAccRules.
+struct FileHeader
+{
+    char m_magic[8];
+    uint32_t m_version;
+    // Detects a file written on a machine with a different byte order.
+    uint32_t m_byte_order;
+    uint64_t m_config_hash;
+    uint64_t m_entries;
+};
+
+struct EntryHeader
+{
+    TokenDigest m_digest;
+    // Wall-clock time, in milliseconds since the epoch.
+    int64_t m_expiry;
+};
+
+}
+
+
+bool
+scitokens_xrootd::SaveCacheFile(const std::string &path, uint64_t config_hash, const TokenCache &cache,
+                                size_t &saved, std::string &err)
+{
+    uint64_t now = monotonic_time_ms();
+    int64_t wall_now = wall_time_ms();
+    auto items = cache.items(now);
+
+    FileHeader header;
+    memcpy(header.m_magic, g_magic, sizeof(g_magic));
+    header.m_version = g_version;
+    header.m_byte_order = 0x01020304;
+    header.m_config_hash = config_hash;
+    header.m_entries = items.size();
+
+    std::string contents(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (const auto &item : items) {
+        EntryHeader entry;
+        entry.m_digest = item.m_digest;
+        entry.m_expiry = wall_now + static_cast<int64_t>(item.m_expiry - now);
+        contents.append(reinterpret_cast<const char *>(&entry), sizeof(entry));
+        item.m_rules->serialize(contents);
+    }
+
+    // The file is created afresh, so anything planted at its path in a
+    // directory others can write to, such as a symlink, is never followed
+    // or overwritten: the open fails instead.  A file left by an earlier
+    // save that did not finish is removed first.
+    auto tmp_path = path + ".tmp";
+    if (unlink(tmp_path.c_str()) && errno != ENOENT) {
+        err = "Unable to remove " + tmp_path + ": " + strerror(errno);
+        return false;
+    }
+    int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        err = "Unable to create " + tmp_path + ": " + strerror(errno);
+        return false;
+    }
+    // The same requirement LoadCacheFile() places on the file it reads.
+    struct stat st;
+    if (fstat(fd, &st) || st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH))) {
+        err = "Not saving to " + tmp_path + ": it must be owned by this user and writable by no one else";
+        close(fd);
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    size_t offset = 0;
+    while (offset < contents.size()) {
+        auto written = write(fd, contents.data() + offset, contents.size() - offset);
+        if (written < 0 && errno == EINTR) {continue;}
+        if (written <= 0) {
+            err = "Unable to write " + tmp_path + ": " + strerror(errno);
+            close(fd);
+            unlink(tmp_path.c_str());
+            return false;
+        }
+        offset += written;
+    }
+    if (close(fd) || rename(tmp_path.c_str(), path.c_str())) {
+        err = "Unable to replace " + path + ": " + strerror(errno);
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    saved = items.size();
+    return true;
+}
+
+
+bool
+scitokens_xrootd::LoadCacheFile(const std::string &path, uint64_t config_hash, TokenCache &cache,
+                                size_t &loaded, std::string &err)
+{
+    loaded = 0;
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT) {return true;}
+        err = "Unable to open " + path + ": " + strerror(errno);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st)) {
+        err = "Unable to stat " + path + ": " + strerror(errno);
+        close(fd);
+        return false;
+    }
+    if (st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH))) {
+        err = "Ignoring " + path + ": it must be owned by this user and writable by no one else";
+        close(fd);
+        return false;
+    }
+    if (static_cast<size_t>(st.st_size) < sizeof(FileHeader)) {
+        close(fd);
+        err = "Ignoring " + path + ": file is truncated";
+        return false;
+    }
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        err = "Unable to map " + path + ": " + strerror(errno);
+        return false;
+    }
+
+    const char *data = static_cast<const char *>(map);
+    const char *end = data + st.st_size;
+    FileHeader header;
+    memcpy(&header, data, sizeof(header));
+    data += sizeof(header);
+    bool success = true;
+    if (memcmp(header.m_magic, g_magic, sizeof(g_magic)) || header.m_version != g_version ||
+        header.m_byte_order != 0x01020304)
+    {
+        err = "Ignoring " + path + ": not a cache file written by this version";
+        success = false;
+    } else if (header.m_config_hash == config_hash) {
+        uint64_t now = monotonic_time_ms();
+        int64_t wall_now = wall_time_ms();
+        try {
+            for (uint64_t idx = 0; idx < header.m_entries; idx++) {
+                EntryHeader entry;
+                if (static_cast<size_t>(end - data) < sizeof(entry)) {
+                    err = "Ignoring the rest of " + path + ": file is truncated";
+                    success = false;
+                    break;
+                }
+                memcpy(&entry, data, sizeof(entry));
+                data += sizeof(entry);
+                auto rules = XrdAccRules::deserialize(data, end);
+                if (!rules) {
+                    err = "Ignoring the rest of " + path + ": malformed entry";
+                    success = false;
+                    break;
+                }
+                if (entry.m_expiry <= wall_now) {continue;}
+                cache.insert(entry.m_digest, std::move(rules), now + (entry.m_expiry - wall_now), now);
+                loaded++;
+            }
+        } catch (std::exception &exc) {
+            err = std::string("Failed to restore cache entries: ") + exc.what();
+            success = false;
+        }
+    }
+    munmap(map, st.st_size);
+    return success;
+}
@@ -0,0 +1,35 @@
+#ifndef __SCITOKENS_CACHE_FILE_HH
+#define __SCITOKENS_CACHE_FILE_HH
+
+#include <stdint.h>
+
+#include <string>
+
+namespace scitokens_xrootd {
+
+class TokenCache;
+
+// Persistence of the validated-token cache across restarts.
+//
+// The file holds, for each cached token, its digest, its expiry as wall-clock
+// time and its compiled rules, under a header recording the hash of the
+// configuration the rules were derived from.  Loading skips the whole file
+// if that hash differs from the current configuration's, and skips each
+// entry that has expired since it was saved, so only rules the current
+// configuration would still produce are restored.  Since the file grants
+// access to whoever holds a matching token, it is only loaded if it is owned
+// by the current user and not writable by anyone else.
+
+// Write the unexpired entries of `cache` to `path`, replacing it atomically.
+// Returns false and sets `err` on failure.
+bool SaveCacheFile(const std::string &path, uint64_t config_hash, const TokenCache &cache,
+                   size_t &saved, std::string &err);
+
+// Insert the still-valid entries of `path` into `cache`.  A missing file is
+// not an error.  Returns false and sets `err` if the file cannot be used.
+bool LoadCacheFile(const std::string &path, uint64_t config_hash, TokenCache &cache,
+                   size_t &loaded, std::string &err);
+
+}
+
+#endif
@@ -0,0 +1,260 @@
+
+#include "scitokens_config.hh"
+
+#include <ctype.h>
+#include <string.h>
+
+#include <algorithm>
+#include <unordered_set>
+
+#include <openssl/sha.h>
+
+#include "INIReader.h"
+
+using namespace scitokens_xrootd;
+
+namespace {
+
+uint64_t Digest(const std::string &contents)
+{
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    SHA256(reinterpret_cast<const unsigned char *>(contents.data()), contents.size(), digest);
+    uint64_t result;
+    memcpy(&result, digest, sizeof(result));
+    return result;
+}
+
+std::vector<std::string> ParseBasePaths(const std::string &base_path)
+{
+    std::vector<std::string> result;
+    ParseCanonicalPaths(base_path, result);
+    // A repeated base path would only repeat its rules.
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+std::vector<std::string> ParseRestrictedPaths(const std::string &restricted_path)
+{
+    std::vector<std::string> result;
+    if (!restricted_path.empty()) {
+        ParseCanonicalPaths(restricted_path, result);
+    }
+    return result;
+}
+
+uint64_t HashIssuer(const IssuerConfig &issuer)
+{
+    std::string contents;
+    auto append = [&](const std::string &value) {
+        contents += value;
+        contents.push_back('\0');
+    };
+    append(issuer.m_url);
+    append(issuer.m_name);
+    append(issuer.m_default_user);
+    append(issuer.m_map_subject ? "1" : "0");
+    for (const auto &path : issuer.m_base_paths) {append(path);}
+    contents.push_back('\1');
+    for (const auto &path : issuer.m_restricted_paths.paths()) {append(path);}
+    contents.push_back('\1');
+    return Digest(contents);
+}
+
+}
+
+
+void
+scitokens_xrootd::ParseCanonicalPaths(const std::string &path, std::vector<std::string> &results)
+{
+    // Long lists continue on indented lines, which INIReader joins with
+    // newlines.
+    size_t pos = 0;
+    do {
+        while (path.size() > pos && (path[pos] == ',' || path[pos] == ' ' || path[pos] == '\n')) {pos++;}
+        auto next_pos = path.find_first_of(", \n", pos);
+        auto next_path = path.substr(pos, next_pos - pos);
+        pos = next_pos;
+        if (!next_path.empty()) {
+            std::string canonical_path;
+            if (MakeCanonical(next_path, canonical_path)) {
+                results.emplace_back(std::move(canonical_path));
+            }
+        }
+    } while (pos != std::string::npos);
+}
+
+
+bool
+scitokens_xrootd::ReadIssuerSection(const INIReader &reader, const std::string &section, IssuerSection &result,
+                                    std::string &err)
+{
+    result.m_url = reader.Get(section, "issuer", "");
+    if (result.m_url.empty()) {
+        err = "Ignoring section because 'issuer' attribute is not set:";
+        return false;
+    }
+    result.m_base_path = reader.Get(section, "base_path", "");
+    if (result.m_base_path.empty()) {
+        err = "Ignoring section because 'base_path' attribute is not set:";
+        return false;
+    }
+    size_t pos = 7;
+    while (section.size() > pos && isspace(section[pos])) {pos++;}
+    result.m_name = section.substr(pos);
+    if (result.m_name.empty()) {
+        err = "Invalid section name:";
+        return false;
+    }
+    result.m_restricted_path = reader.Get(section, "restricted_path", "");
+    result.m_default_user = reader.Get(section, "default_user", "");
+    result.m_map_subject = reader.GetBoolean(section, "map_subject", false);
+    result.m_jwks_file = reader.Get(section, "jwks_file", "");
+    return true;
+}
+
+
+EnforcerPool::~EnforcerPool()
+{
+    for (auto enf : m_idle) {
+        enforcer_destroy(enf);
+    }
+}
+
+
+Enforcer
+EnforcerPool::acquire(const char **audiences, char **err_msg)
+{
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        if (!m_idle.empty()) {
+            auto enf = m_idle.back();
+            m_idle.pop_back();
+            return enf;
+        }
+    }
+    return enforcer_create(m_issuer.c_str(), audiences, err_msg);
+}
+
+
+void
+EnforcerPool::release(Enforcer enf)
+{
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        if (m_idle.size() < m_max_idle) {
+            m_idle.push_back(enf);
+            return;
+        }
+    }
+    enforcer_destroy(enf);
+}
+
+
+IssuerConfig::IssuerConfig(const IssuerSection &section)
+    : m_section(section),
+      m_map_subject(section.m_map_subject),
+      m_name(section.m_name),
+      m_url(section.m_url),
+      m_default_user(section.m_default_user),
+      m_base_paths(ParseBasePaths(section.m_base_path)),
+      m_restricted_paths(ParseRestrictedPaths(section.m_restricted_path)),
+      m_hash(HashIssuer(*this)),
+      m_enforcers(section.m_url)
+{}
+
+
+void
+IssuerConfig::map_acl(const char *authz, const std::string &acl_path, AccessRulesRaw &rules) const
+{
+    Access_Operation first, second;
+    if (!strcmp(authz, "read")) {
+        first = AOP_Read;
+        second = AOP_Stat;
+    } else if (!strcmp(authz, "write")) {
+        first = AOP_Update;
+        second = AOP_Create;
+    } else {
+        return;
+    }
+    if (!m_restricted_paths.empty() && !m_restricted_paths.matches(acl_path)) {return;}
+    for (const auto &base_path : m_base_paths) {
+        // Both halves are canonical; only a root at either end needs care.
+        std::string path = base_path == "/" ? acl_path :
+            (acl_path == "/" ? base_path : base_path + acl_path);
+        rules.emplace_back(first, path);
+        rules.emplace_back(second, std::move(path));
+    }
+}
+
+
+ConfigSnapshot::ConfigSnapshot(std::vector<std::string> audiences, const std::vector<IssuerSection> &sections,
+                               const ConfigSnapshot *previous)
+    : m_audiences(std::move(audiences))
+{
+    m_audiences_array.reserve(m_audiences.size() + 1);
+    for (const auto &audience : m_audiences) {
+        m_audiences_array.push_back(audience.c_str());
+    }
+    m_audiences_array.push_back(nullptr);
+
+    // Pooled enforcers were created for the previous audiences.
+    if (previous && previous->m_audiences != m_audiences) {previous = nullptr;}
+    std::unordered_set<std::string> seen;
+    for (const auto &section : sections) {
+        if (!seen.insert(section.m_url).second) {continue;}
+        std::shared_ptr<const IssuerConfig> issuer;
+        if (previous) {
+            auto idx = previous->m_issuer_table.find(section.m_url);
+            if (idx >= 0 && previous->m_issuers[idx]->m_section == section) {
+                issuer = previous->m_issuers[idx];
+            }
+        }
+        if (!issuer) {
+            issuer = std::make_shared<const IssuerConfig>(section);
+            m_issuers_compiled++;
+        }
+        m_issuers.push_back(std::move(issuer));
+    }
+
+    // The same hash whatever the order of the sections.
+    std::vector<std::pair<std::string, uint64_t>> hashes;
+    hashes.reserve(m_issuers.size());
+    for (const auto &issuer : m_issuers) {
+        hashes.emplace_back(issuer->m_url, issuer->m_hash);
+        m_valid_issuers.push_back(issuer->m_url);
+    }
+    std::sort(hashes.begin(), hashes.end());
+    std::string contents;
+    for (const auto &audience : m_audiences) {
+        contents += audience;
+        contents.push_back('\0');
+    }
+    contents.push_back('\1');
+    for (const auto &entry : hashes) {
+        contents.append(reinterpret_cast<const char *>(&entry.second), sizeof(entry.second));
+    }
+    m_hash = Digest(contents);
+
+    m_valid_issuers_array.reserve(m_valid_issuers.size() + 1);
+    for (const auto &issuer : m_valid_issuers) {
+        m_valid_issuers_array.push_back(issuer.c_str());
+    }
+    m_valid_issuers_array.push_back(nullptr);
+    m_issuer_table = IssuerTable(m_valid_issuers);
+}
+
+
+bool
+ConfigSnapshot::accepts_audience(const std::vector<std::string> &audiences) const
+{
+    if (audiences.empty() || m_audiences.empty()) {return true;}
+    for (const auto &audience : audiences) {
+        if (audience == "ANY" || audience == "https://wlcg.cern.ch/jwt/v1/any" ||
+            std::find(m_audiences.begin(), m_audiences.end(), audience) != m_audiences.end())
+        {
+            return true;
+        }
+    }
+    return false;
+}
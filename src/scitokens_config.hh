@@ -0,0 +1,146 @@
+#ifndef __SCITOKENS_CONFIG_HH
+#define __SCITOKENS_CONFIG_HH
+
+#include <stdint.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "scitokens/scitokens.h"
+
+#include "scitokens_issuers.hh"
+#include "scitokens_path.hh"
+#include "scitokens_rules.hh"
+
+class INIReader;
+
+namespace scitokens_xrootd {
+
+// Append the canonical form of each absolute path in the list `path`,
+// separated by commas, spaces or newlines, to `results`.
+void ParseCanonicalPaths(const std::string &path, std::vector<std::string> &results);
+
+// An [Issuer ...] section of the configuration file, as written.
+struct IssuerSection
+{
+    bool operator==(const IssuerSection &other) const {
+        return m_name == other.m_name && m_url == other.m_url && m_base_path == other.m_base_path &&
+            m_restricted_path == other.m_restricted_path && m_default_user == other.m_default_user &&
+            m_jwks_file == other.m_jwks_file && m_map_subject == other.m_map_subject;
+    }
+
+    std::string m_name;
+    std::string m_url;
+    std::string m_base_path;
+    std::string m_restricted_path;
+    std::string m_default_user;
+    std::string m_jwks_file;
+    bool m_map_subject{false};
+};
+
+// Read the issuer section `section` of `reader`.  Returns false and sets
+// `err` if the section must be ignored.
+bool ReadIssuerSection(const INIReader &reader, const std::string &section, IssuerSection &result,
+                       std::string &err);
+
+// Enforcers for one issuer, kept for the life of its configuration so a
+// cache miss does not pay for enforcer_create()/enforcer_destroy().  An
+// Enforcer is not safe for concurrent use, so each validation checks one out
+// and returns it afterwards.
+class EnforcerPool
+{
+public:
+    explicit EnforcerPool(const std::string &issuer) : m_issuer(issuer) {}
+    ~EnforcerPool();
+
+    EnforcerPool(const EnforcerPool &) = delete;
+    EnforcerPool &operator=(const EnforcerPool &) = delete;
+
+    // Returns an idle enforcer or creates a new one; nullptr (with `err_msg`
+    // set) on failure.  Every enforcer returned must be given to release().
+    Enforcer acquire(const char **audiences, char **err_msg);
+
+    void release(Enforcer enf);
+
+private:
+    static constexpr size_t m_max_idle = 64;
+
+    const std::string m_issuer;
+    std::mutex m_mutex;
+    std::vector<Enforcer> m_idle;
+};
+
+// One issuer's settings, compiled for mapping the ACLs of its tokens to
+// rules: the restricted paths are indexed and duplicate base paths dropped.
+struct IssuerConfig
+{
+    explicit IssuerConfig(const IssuerSection &section);
+
+    IssuerConfig(const IssuerConfig &) = delete;
+    IssuerConfig &operator=(const IssuerConfig &) = delete;
+
+    // Append the rules granted by a token ACL with authorization `authz`
+    // ("read" or "write") on the canonical path `acl_path`: nothing if it
+    // lies outside the restricted paths, else one pair of rules per base
+    // path.
+    void map_acl(const char *authz, const std::string &acl_path, AccessRulesRaw &rules) const;
+
+    const IssuerSection m_section;
+    const bool m_map_subject;
+    const std::string m_name;
+    const std::string m_url;
+    const std::string m_default_user;
+    const std::vector<std::string> m_base_paths;
+    // Empty if the issuer is not restricted.
+    const PathPrefixSet m_restricted_paths;
+    // Of every setting above which affects the rules.
+    const uint64_t m_hash;
+    mutable EnforcerPool m_enforcers;
+};
+
+// Everything derived from the configuration file.  A snapshot is never
+// modified after it is published; Reconfig() builds a new one and swaps it in.
+struct ConfigSnapshot
+{
+    // Only the first section naming a given issuer URL is used.  When the
+    // audiences are those of `previous`, an issuer whose section has not
+    // changed keeps its compiled configuration from `previous`, enforcers
+    // included, so a reload only rebuilds the sections that were edited.
+    ConfigSnapshot(std::vector<std::string> audiences, const std::vector<IssuerSection> &sections,
+                   const ConfigSnapshot *previous);
+
+    ConfigSnapshot(const ConfigSnapshot &) = delete;
+    ConfigSnapshot &operator=(const ConfigSnapshot &) = delete;
+
+    // The configuration of the issuer with URL `issuer`, or nullptr.
+    const IssuerConfig *find_issuer(const std::string &issuer) const {
+        auto idx = m_issuer_table.find(issuer);
+        return idx < 0 ? nullptr : m_issuers[idx].get();
+    }
+
+    // False only if a token with the audiences `audiences` is certain to be
+    // refused by the enforcer: it names audiences, none of them is
+    // configured and none is a wildcard.  With no audiences configured the
+    // decision is left to the enforcer.
+    bool accepts_audience(const std::vector<std::string> &audiences) const;
+
+    const std::vector<std::string> m_audiences;
+    std::vector<const char *> m_audiences_array;
+    std::vector<std::string> m_valid_issuers;
+    std::vector<const char *> m_valid_issuers_array;
+    // Shared with later snapshots that leave the issuer unchanged.
+    std::vector<std::shared_ptr<const IssuerConfig>> m_issuers;
+    // Routes an issuer URL to its entry of m_issuers.
+    IssuerTable m_issuer_table;
+    // Of every setting which affects the rules generated for a token, so
+    // cached rules can be matched with the configuration that produced them.
+    uint64_t m_hash{0};
+    // Issuers compiled for this snapshot rather than taken from the previous.
+    size_t m_issuers_compiled{0};
+};
+
+}
+
+#endif
@@ -0,0 +1,118 @@
+
+#include "scitokens_epoch.hh"
+
+using namespace scitokens_xrootd;
+
+std::atomic<uint64_t> EpochDomain::m_instances{0};
+
+
+EpochDomain::EpochDomain()
+    : m_id(++m_instances)
+{}
+
+
+EpochDomain::~EpochDomain()
+{
+    for (const auto &retired : m_retired) {
+        retired.m_deleter(retired.m_ptr);
+    }
+}
+
+
+EpochDomain::Record &
+EpochDomain::local()
+{
+    struct ThreadRecord
+    {
+        uint64_t m_owner{0};
+        Record *m_record{nullptr};
+    };
+    static thread_local ThreadRecord thread_record;
+
+    if (thread_record.m_owner != m_id) {
+        // A thread alternating between domains finds its record again; one
+        // reusing the id of a thread that has exited inherits that record,
+        // which is idle.
+        auto self = std::this_thread::get_id();
+        std::lock_guard<std::mutex> guard(m_mutex);
+        Record *found = nullptr;
+        for (const auto &record : m_records) {
+            if (record->m_thread == self) {
+                found = record.get();
+                break;
+            }
+        }
+        if (!found) {
+            m_records.emplace_back(new Record());
+            found = m_records.back().get();
+            found->m_thread = self;
+        }
+        thread_record.m_record = found;
+        thread_record.m_owner = m_id;
+    }
+    return *thread_record.m_record;
+}
+
+
+void
+EpochDomain::retire(void *ptr, void (*deleter)(void *))
+{
+    std::vector<Retired> ready;
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_retired.push_back(Retired{ptr, deleter, m_epoch.load(std::memory_order_relaxed)});
+        if (m_retired.size() >= m_batch) {
+            advance_and_reclaim(ready);
+        }
+    }
+    for (const auto &retired : ready) {
+        retired.m_deleter(retired.m_ptr);
+    }
+}
+
+
+void
+EpochDomain::reclaim()
+{
+    std::vector<Retired> ready;
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        advance_and_reclaim(ready);
+    }
+    for (const auto &retired : ready) {
+        retired.m_deleter(retired.m_ptr);
+    }
+}
+
+
+void
+EpochDomain::advance_and_reclaim(std::vector<Retired> &ready)
+{
+    // The epoch may only advance once every reader inside a Guard has seen
+    // the current one.  An object retired in epoch E was unlinked before any
+    // reader entered epoch E + 1, so once the epoch reaches E + 2 no reader
+    // can still hold it.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto epoch = m_epoch.load(std::memory_order_relaxed);
+    bool quiescent = true;
+    for (const auto &record : m_records) {
+        auto local = record->m_epoch.load(std::memory_order_acquire);
+        if (local && local != epoch) {
+            quiescent = false;
+            break;
+        }
+    }
+    if (quiescent) {
+        m_epoch.store(++epoch, std::memory_order_relaxed);
+    }
+
+    size_t kept = 0;
+    for (size_t idx = 0; idx < m_retired.size(); idx++) {
+        if (m_retired[idx].m_epoch + 2 <= epoch) {
+            ready.push_back(m_retired[idx]);
+        } else {
+            m_retired[kept++] = m_retired[idx];
+        }
+    }
+    m_retired.resize(kept);
+}
@@ -0,0 +1,119 @@
+#ifndef __SCITOKENS_EPOCH_HH
+#define __SCITOKENS_EPOCH_HH
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace scitokens_xrootd {
+
+// Epoch-based reclamation for lock-free readers.
+//
+// A reader brackets its accesses to shared objects with a Guard.  A writer
+// that unlinks an object hands it to retire() instead of deleting it; the
+// object is only deleted once every thread that was inside a Guard when it
+// was retired has left it.  Entering and leaving a Guard only write to the
+// calling thread's own record, so readers on different cores never write to
+// a shared cache line.
+class EpochDomain
+{
+    // One per thread and domain; only ever written by its thread.  Padded so
+    // no two records share a cache line, however the allocator places them.
+    struct Record
+    {
+        char m_pad_before[64];
+        // The epoch the thread entered, or 0 when it is outside any Guard.
+        std::atomic<uint64_t> m_epoch{0};
+        unsigned m_depth{0};
+        std::thread::id m_thread;
+        char m_pad_after[64];
+    };
+
+public:
+    class Guard
+    {
+    public:
+        explicit Guard(EpochDomain &domain);
+        ~Guard();
+
+        Guard(const Guard &) = delete;
+        Guard &operator=(const Guard &) = delete;
+
+    private:
+        Record &m_record;
+    };
+
+    EpochDomain();
+    // Deletes everything still waiting to be reclaimed; no Guard may be
+    // active.
+    ~EpochDomain();
+
+    EpochDomain(const EpochDomain &) = delete;
+    EpochDomain &operator=(const EpochDomain &) = delete;
+
+    // Arrange for `deleter(ptr)` to be called once no reader can still hold
+    // `ptr`.  The caller must already have made `ptr` unreachable.
+    void retire(void *ptr, void (*deleter)(void *));
+
+    template<typename T>
+    void retire(T *ptr) {
+        retire(ptr, [](void *value) {delete static_cast<T *>(value);});
+    }
+
+    // Reclaim whatever has become safe to delete.
+    void reclaim();
+
+private:
+    struct Retired
+    {
+        void *m_ptr;
+        void (*m_deleter)(void *);
+        uint64_t m_epoch;
+    };
+
+    Record &local();
+    // Requires m_mutex.
+    void advance_and_reclaim(std::vector<Retired> &ready);
+
+    // The reclamation threshold; retire() only scans the readers once this
+    // many objects are pending.
+    static constexpr size_t m_batch = 64;
+
+    std::atomic<uint64_t> m_epoch{1};
+    const uint64_t m_id;
+    static std::atomic<uint64_t> m_instances;
+
+    std::mutex m_mutex;
+    std::vector<std::unique_ptr<Record>> m_records;
+    std::vector<Retired> m_retired;
+};
+
+
+inline
+EpochDomain::Guard::Guard(EpochDomain &domain)
+    : m_record(domain.local())
+{
+    if (!m_record.m_depth++) {
+        m_record.m_epoch.store(domain.m_epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        // Publish the epoch before reading any shared object; pairs with the
+        // fence in advance_and_reclaim().
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+}
+
+
+inline
+EpochDomain::Guard::~Guard()
+{
+    if (!--m_record.m_depth) {
+        m_record.m_epoch.store(0, std::memory_order_release);
+    }
+}
+
+}
+
+#endif
@@ -0,0 +1,144 @@
+
+#include "scitokens_issuers.hh"
+
+#include <string.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace scitokens_xrootd;
+
+namespace {
+
+// Seeds tried per bucket before the table is grown.
+const uint32_t g_max_attempts = 1 << 16;
+
+// Sends a key's hash to its slot, given the seed of its bucket.
+inline uint64_t mix(uint64_t value)
+{
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+    return value;
+}
+
+size_t next_power_of_two(size_t value)
+{
+    size_t result = 1;
+    while (result < value) {result <<= 1;}
+    return result;
+}
+
+}
+
+
+uint64_t
+IssuerTable::hash(const char *data, size_t len, uint64_t seed)
+{
+    // One multiply per word; mix() supplies the avalanche.
+    uint64_t result = (seed + len) * 0x9e3779b97f4a7c15ULL;
+    const char *end = data + len;
+    for (; end - data >= 8; data += 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        result = (result ^ word) * 0x9fb21c651e98df25ULL;
+        result ^= result >> 29;
+    }
+    if (data != end) {
+        uint64_t word = 0;
+        if (len >= 8) {
+            // The last eight bytes, overlapping the previous word, rather
+            // than a variable-length copy.
+            memcpy(&word, end - 8, 8);
+        } else {
+            for (unsigned shift = 0; data != end; data++, shift += 8) {
+                word |= static_cast<uint64_t>(static_cast<unsigned char>(*data)) << shift;
+            }
+        }
+        result = (result ^ word) * 0x9fb21c651e98df25ULL;
+    }
+    return mix(result);
+}
+
+
+IssuerTable::IssuerTable(std::vector<std::string> issuers)
+    : m_keys(std::move(issuers))
+{
+    auto sorted = m_keys;
+    std::sort(sorted.begin(), sorted.end());
+    if (std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end()) {
+        throw std::invalid_argument("duplicate issuer");
+    }
+    if (m_keys.empty()) {return;}
+
+    // Keys whose hashes collide could never be told apart by their seeds.
+    std::vector<uint64_t> hashes;
+    while (true) {
+        hashes.clear();
+        for (const auto &key : m_keys) {hashes.push_back(hash(key.data(), key.size(), m_hash_seed));}
+        auto sorted_hashes = hashes;
+        std::sort(sorted_hashes.begin(), sorted_hashes.end());
+        if (std::adjacent_find(sorted_hashes.begin(), sorted_hashes.end()) == sorted_hashes.end()) {break;}
+        m_hash_seed++;
+    }
+    // At most half the slots are used, so seeds are quick to find.
+    auto slot_count = next_power_of_two(2 * m_keys.size());
+    while (!build(slot_count, hashes)) {slot_count <<= 1;}
+}
+
+
+bool
+IssuerTable::build(size_t slot_count, const std::vector<uint64_t> &hashes)
+{
+    auto bucket_count = next_power_of_two(std::max<size_t>(1, m_keys.size() / 2));
+    m_bucket_mask = bucket_count - 1;
+    m_slot_mask = slot_count - 1;
+    m_seeds.assign(bucket_count, 0);
+    m_slots.assign(slot_count, -1);
+
+    std::vector<std::vector<int32_t>> buckets(bucket_count);
+    for (size_t idx = 0; idx < m_keys.size(); idx++) {
+        buckets[hashes[idx] & m_bucket_mask].push_back(idx);
+    }
+    // Place the largest buckets while the table is emptiest.
+    std::vector<size_t> order(bucket_count);
+    for (size_t idx = 0; idx < bucket_count; idx++) {order[idx] = idx;}
+    std::stable_sort(order.begin(), order.end(),
+        [&](size_t left, size_t right) {return buckets[left].size() > buckets[right].size();});
+
+    std::vector<uint64_t> placed;
+    for (auto bucket : order) {
+        const auto &members = buckets[bucket];
+        if (members.empty()) {break;}
+        uint32_t seed = 1;
+        for (; seed <= g_max_attempts; seed++) {
+            placed.clear();
+            for (auto member : members) {
+                auto slot = mix(hashes[member] ^ seed) & m_slot_mask;
+                if (m_slots[slot] >= 0 || std::find(placed.begin(), placed.end(), slot) != placed.end()) {break;}
+                placed.push_back(slot);
+            }
+            if (placed.size() == members.size()) {break;}
+        }
+        if (seed > g_max_attempts) {return false;}
+        m_seeds[bucket] = seed;
+        for (size_t idx = 0; idx < members.size(); idx++) {
+            m_slots[placed[idx]] = members[idx];
+        }
+    }
+    return true;
+}
+
+
+int
+IssuerTable::find(const char *issuer, size_t len) const
+{
+    if (m_keys.empty()) {return -1;}
+    auto key_hash = hash(issuer, len, m_hash_seed);
+    auto idx = m_slots[mix(key_hash ^ m_seeds[key_hash & m_bucket_mask]) & m_slot_mask];
+    if (idx < 0) {return -1;}
+    const auto &key = m_keys[idx];
+    return key.size() == len && !memcmp(key.data(), issuer, len) ? idx : -1;
+}
@@ -0,0 +1,54 @@
+#ifndef __SCITOKENS_ISSUERS_HH
+#define __SCITOKENS_ISSUERS_HH
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace scitokens_xrootd {
+
+// A static map from issuer URL to its position in the list the table was
+// built from, using a two-level perfect hash over one pass of the key: its
+// hash picks a bucket, each bucket stores the seed of a second mix of the
+// same hash which sends its keys to distinct slots, and a lookup is that
+// pass, one mix and one string comparison however many issuers are
+// configured.  Built once per configuration, so construction may search for
+// seeds.
+class IssuerTable
+{
+public:
+    IssuerTable() {}
+
+    // Throws std::invalid_argument if `issuers` has duplicates.
+    explicit IssuerTable(std::vector<std::string> issuers);
+
+    // The index of `issuer` in the list given to the constructor, or -1.
+    int find(const char *issuer, size_t len) const;
+
+    int find(const std::string &issuer) const {return find(issuer.data(), issuer.size());}
+
+    size_t size() const {return m_keys.size();}
+
+    static uint64_t hash(const char *data, size_t len, uint64_t seed);
+
+private:
+    // Try to place every key into `slot_count` slots; false if some bucket
+    // found no seed within the attempt limit.
+    bool build(size_t slot_count, const std::vector<uint64_t> &hashes);
+
+    std::vector<std::string> m_keys;
+    // Chosen so no two keys hash alike.
+    uint64_t m_hash_seed{0};
+    // Per bucket.
+    std::vector<uint32_t> m_seeds;
+    // Per slot: an index into m_keys, or -1.
+    std::vector<int32_t> m_slots;
+    uint64_t m_bucket_mask{0};
+    uint64_t m_slot_mask{0};
+};
+
+}
+
+#endif
@@ -0,0 +1,294 @@
+
+#include "scitokens_jwt.hh"
+
+#include <stdint.h>
+
+#include "picojson.h"
+
+#ifdef SCITOKENS_JWT_X86
+#include <immintrin.h>
+#endif
+
+using namespace scitokens_xrootd;
+
+namespace {
+
+enum CharClass : unsigned char
+{
+    Invalid,
+    Base64,
+    Separator
+};
+
+struct CharClasses
+{
+    CharClasses() {
+        for (unsigned idx = 0; idx < 256; idx++) {
+            bool base64 = (idx >= 'A' && idx <= 'Z') || (idx >= 'a' && idx <= 'z') || (idx >= '0' && idx <= '9') ||
+                idx == '+' || idx == '/' || idx == '-' || idx == '_';
+            m_classes[idx] = base64 ? Base64 : (idx == '.' ? Separator : Invalid);
+        }
+    }
+
+    unsigned char m_classes[256];
+};
+
+const CharClasses g_char_classes;
+
+// The 6-bit value of each base64 or base64url character, else 0xff.
+struct Base64Values
+{
+    Base64Values() {
+        for (unsigned idx = 0; idx < 256; idx++) {m_values[idx] = 0xff;}
+        const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+        for (unsigned idx = 0; idx < 62; idx++) {
+            m_values[static_cast<unsigned char>(alphabet[idx])] = idx;
+        }
+        m_values['+'] = m_values['-'] = 62;
+        m_values['/'] = m_values['_'] = 63;
+    }
+
+    unsigned char m_values[256];
+};
+
+const Base64Values g_base64_values;
+
+// Positions of the separators found so far.
+struct Separators
+{
+    // Returns false once there would be more than two.
+    bool add(size_t pos) {
+        if (m_count == 2) {return false;}
+        m_positions[m_count++] = pos;
+        return true;
+    }
+
+    size_t m_positions[2];
+    unsigned m_count{0};
+};
+
+void set_span(JwtSpan &span, size_t begin, size_t end)
+{
+    span.m_offset = begin;
+    span.m_length = end - begin;
+}
+
+bool scan_scalar(const unsigned char *data, size_t idx, size_t len, Separators &separators)
+{
+    const unsigned char *classes = g_char_classes.m_classes;
+    for (; idx < len; idx++) {
+        auto cls = classes[data[idx]];
+        if (__builtin_expect(cls != Base64, 0) && (cls == Invalid || !separators.add(idx))) {return false;}
+    }
+    return true;
+}
+
+bool finish(size_t len, const Separators &separators, JwtSpans &spans)
+{
+    if (separators.m_count != 2) {return false;}
+    set_span(spans.m_header, 0, separators.m_positions[0]);
+    set_span(spans.m_payload, separators.m_positions[0] + 1, separators.m_positions[1]);
+    set_span(spans.m_signature, separators.m_positions[1] + 1, len);
+    return true;
+}
+
+#ifdef SCITOKENS_JWT_X86
+
+// The separators set in `mask`, a bitmap of positions from `base`.
+bool add_separators(size_t base, unsigned mask, Separators &separators)
+{
+    while (mask) {
+        if (!separators.add(base + __builtin_ctz(mask))) {return false;}
+        mask &= mask - 1;
+    }
+    return true;
+}
+
+// Bytes in [lo, hi].  The compares are signed, so bytes of 0x80 and above
+// are negative and never in range.
+inline __m128i in_range(__m128i bytes, char lo, char hi)
+{
+    return _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8(lo - 1)),
+                         _mm_cmplt_epi8(bytes, _mm_set1_epi8(hi + 1)));
+}
+
+// Classify 16 bytes at `data + idx`.
+inline bool scan_sse2_block(const unsigned char *data, size_t idx, Separators &separators)
+{
+    auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + idx));
+    // '-', '.', '/' and the digits are contiguous; setting bit 5 folds the
+    // upper case letters onto the lower case ones.
+    auto valid = _mm_or_si128(
+        _mm_or_si128(in_range(bytes, '-', '9'), in_range(_mm_or_si128(bytes, _mm_set1_epi8(0x20)), 'a', 'z')),
+        _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('+')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('_'))));
+    if (_mm_movemask_epi8(valid) != 0xffff) {return false;}
+    unsigned dots = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('.')));
+    return !dots || add_separators(idx, dots, separators);
+}
+
+__attribute__((target("avx2")))
+inline __m256i in_range_avx2(__m256i bytes, char lo, char hi)
+{
+    return _mm256_and_si256(_mm256_cmpgt_epi8(bytes, _mm256_set1_epi8(lo - 1)),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), bytes));
+}
+
+#endif
+
+}
+
+
+bool
+scitokens_xrootd::ScanJwtScalar(const char *token, size_t len, JwtSpans &spans)
+{
+    Separators separators;
+    return scan_scalar(reinterpret_cast<const unsigned char *>(token), 0, len, separators) &&
+        finish(len, separators, spans);
+}
+
+
+bool
+scitokens_xrootd::DecodeJwtSpan(const char *token, const JwtSpan &span, std::string &decoded)
+{
+    decoded.clear();
+    // A single character left over cannot encode a byte.
+    if (span.m_length % 4 == 1) {return false;}
+    decoded.reserve(span.m_length / 4 * 3 + 2);
+    auto data = reinterpret_cast<const unsigned char *>(token + span.m_offset);
+    const unsigned char *values = g_base64_values.m_values;
+    uint32_t bits = 0;
+    unsigned count = 0;
+    for (size_t idx = 0; idx < span.m_length; idx++) {
+        auto value = values[data[idx]];
+        if (value == 0xff) {return false;}
+        bits = (bits << 6) | value;
+        if (++count == 4) {
+            decoded += static_cast<char>(bits >> 16);
+            decoded += static_cast<char>(bits >> 8);
+            decoded += static_cast<char>(bits);
+            bits = 0;
+            count = 0;
+        }
+    }
+    if (count == 2) {
+        decoded += static_cast<char>(bits >> 4);
+    } else if (count == 3) {
+        decoded += static_cast<char>(bits >> 10);
+        decoded += static_cast<char>(bits >> 2);
+    }
+    return true;
+}
+
+
+bool
+scitokens_xrootd::PeekJwtClaims(const char *token, const JwtSpan &span, JwtClaims &claims)
+{
+    std::string json;
+    if (!DecodeJwtSpan(token, span, json)) {return false;}
+    picojson::value payload;
+    if (!picojson::parse(payload, json).empty() || !payload.is<picojson::value::object>()) {return false;}
+    const auto &object = payload.get<picojson::value::object>();
+
+    claims = JwtClaims();
+    auto iter = object.find("iss");
+    if (iter != object.end() && iter->second.is<std::string>()) {
+        claims.m_issuer = iter->second.get<std::string>();
+    }
+    iter = object.find("aud");
+    if (iter != object.end()) {
+        if (iter->second.is<std::string>()) {
+            claims.m_audiences.push_back(iter->second.get<std::string>());
+        } else if (iter->second.is<picojson::value::array>()) {
+            for (const auto &value : iter->second.get<picojson::value::array>()) {
+                if (value.is<std::string>()) {claims.m_audiences.push_back(value.get<std::string>());}
+            }
+        }
+    }
+    iter = object.find("exp");
+    if (iter != object.end() && iter->second.is<double>()) {
+        claims.m_expiry = iter->second.get<double>();
+    }
+    iter = object.find("nbf");
+    if (iter != object.end() && iter->second.is<double>()) {
+        claims.m_not_before = iter->second.get<double>();
+    }
+    return true;
+}
+
+
+bool
+scitokens_xrootd::PeekJwtKeyId(const char *token, const JwtSpan &span, std::string &key_id)
+{
+    std::string json;
+    if (!DecodeJwtSpan(token, span, json)) {return false;}
+    picojson::value header;
+    if (!picojson::parse(header, json).empty() || !header.is<picojson::value::object>()) {return false;}
+    const auto &object = header.get<picojson::value::object>();
+    auto iter = object.find("kid");
+    key_id = iter != object.end() && iter->second.is<std::string>() ? iter->second.get<std::string>() : "";
+    return true;
+}
+
+
+#ifdef SCITOKENS_JWT_X86
+
+bool
+scitokens_xrootd::ScanJwtSse2(const char *token, size_t len, JwtSpans &spans)
+{
+    auto data = reinterpret_cast<const unsigned char *>(token);
+    Separators separators;
+    size_t idx = 0;
+    for (; idx + 16 <= len; idx += 16) {
+        if (!scan_sse2_block(data, idx, separators)) {return false;}
+    }
+    return scan_scalar(data, idx, len, separators) && finish(len, separators, spans);
+}
+
+
+__attribute__((target("avx2")))
+bool
+scitokens_xrootd::ScanJwtAvx2(const char *token, size_t len, JwtSpans &spans)
+{
+    auto data = reinterpret_cast<const unsigned char *>(token);
+    Separators separators;
+    size_t idx = 0;
+    for (; idx + 32 <= len; idx += 32) {
+        auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + idx));
+        auto valid = _mm256_or_si256(
+            _mm256_or_si256(in_range_avx2(bytes, '-', '9'),
+                            in_range_avx2(_mm256_or_si256(bytes, _mm256_set1_epi8(0x20)), 'a', 'z')),
+            _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('+')),
+                            _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('_'))));
+        if (static_cast<unsigned>(_mm256_movemask_epi8(valid)) != 0xffffffffu) {return false;}
+        unsigned dots = _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('.')));
+        if (dots && !add_separators(idx, dots, separators)) {return false;}
+    }
+    if (idx + 16 <= len) {
+        if (!scan_sse2_block(data, idx, separators)) {return false;}
+        idx += 16;
+    }
+    return scan_scalar(data, idx, len, separators) && finish(len, separators, spans);
+}
+
+
+bool
+scitokens_xrootd::CpuHasAvx2()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+#endif
+
+
+bool
+scitokens_xrootd::ScanJwt(const char *token, size_t len, JwtSpans &spans)
+{
+    typedef bool (*Scanner)(const char *, size_t, JwtSpans &);
+#ifdef SCITOKENS_JWT_X86
+    static const Scanner scanner = CpuHasAvx2() ? ScanJwtAvx2 : ScanJwtSse2;
+#else
+    static const Scanner scanner = ScanJwtScalar;
+#endif
+    return scanner(token, len, spans);
+}
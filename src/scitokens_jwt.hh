@@ -0,0 +1,77 @@
+#ifndef __SCITOKENS_JWT_HH
+#define __SCITOKENS_JWT_HH
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SCITOKENS_JWT_X86 1
+#endif
+
+namespace scitokens_xrootd {
+
+// A range of bytes within the token passed to ScanJwt().
+struct JwtSpan
+{
+    size_t m_offset{0};
+    size_t m_length{0};
+};
+
+struct JwtSpans
+{
+    JwtSpan m_header;
+    JwtSpan m_payload;
+    JwtSpan m_signature;
+};
+
+// Cheap screen run before any parsing or cryptography: returns true if the
+// `len` bytes at `token` are three runs of base64 or base64url characters
+// separated by exactly two '.', and sets `spans` to the three runs.  A
+// token that fails is not worth handing to scitokens-cpp, or logging.
+//
+// Uses AVX2 or SSE2 when the CPU has them, else a table-driven scalar loop.
+bool ScanJwt(const char *token, size_t len, JwtSpans &spans);
+
+// Base64url-decode `span` of `token`, as found by ScanJwt(), into `decoded`;
+// the padding JWTs omit is implied.  Returns false if the span is not a valid
+// encoding.
+bool DecodeJwtSpan(const char *token, const JwtSpan &span, std::string &decoded);
+
+// Claims read from a token's payload before its signature is verified, so
+// that tokens which could never be accepted are turned away without any
+// cryptography or key download.  None of them may be trusted until the token
+// has been verified.
+struct JwtClaims
+{
+    // Empty if the claim is missing or not a string.
+    std::string m_issuer;
+    // From a string or an array of strings; empty if absent.
+    std::vector<std::string> m_audiences;
+    // Seconds since the epoch; 0 if absent or not a number.
+    double m_expiry{0};
+    double m_not_before{0};
+};
+
+// Decode the payload `span` of `token` and read its claims into `claims`.
+// Returns false if the payload is not a JSON object.
+bool PeekJwtClaims(const char *token, const JwtSpan &span, JwtClaims &claims);
+
+// Decode the header `span` of `token` and read its `kid` into `key_id`,
+// leaving it empty if absent.  Returns false if the header is not a JSON
+// object.
+bool PeekJwtKeyId(const char *token, const JwtSpan &span, std::string &key_id);
+
+// The implementations ScanJwt() chooses from, for testing and benchmarks.
+bool ScanJwtScalar(const char *token, size_t len, JwtSpans &spans);
+#ifdef SCITOKENS_JWT_X86
+bool ScanJwtSse2(const char *token, size_t len, JwtSpans &spans);
+// Only call if CpuHasAvx2().
+bool ScanJwtAvx2(const char *token, size_t len, JwtSpans &spans);
+bool CpuHasAvx2();
+#endif
+
+}
+
+#endif
@@ -0,0 +1,302 @@
+
+#include "scitokens_keys.hh"
+#include "scitokens_metrics.hh"
+#include "scitokens_rules.hh"
+
+#include "XrdSys/XrdSysError.hh"
+
+#include "scitokens/scitokens.h"
+
+#include "picojson.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+using namespace scitokens_xrootd;
+
+namespace {
+
+// The key cache API only exists in newer releases of scitokens-cpp; CMake
+// detects it and older releases fall back to fetching keys on demand.
+#ifdef HAVE_KEYCACHE_API
+const bool g_have_keycache_api = true;
+
+int set_jwks(const char *issuer, const char *jwks, char **err_msg)
+{
+    return keycache_set_jwks(issuer, jwks, err_msg);
+}
+
+int refresh_jwks(const char *issuer, char **err_msg)
+{
+    return keycache_refresh_jwks(issuer, err_msg);
+}
+
+int get_cached_jwks(const char *issuer, char **jwks, char **err_msg)
+{
+    return keycache_get_cached_jwks(issuer, jwks, err_msg);
+}
+#else
+const bool g_have_keycache_api = false;
+
+int set_jwks(const char *, const char *, char **err_msg)
+{
+    *err_msg = strdup("scitokens-cpp has no keycache_set_jwks");
+    return -1;
+}
+
+int refresh_jwks(const char *, char **err_msg)
+{
+    *err_msg = strdup("scitokens-cpp has no keycache_refresh_jwks");
+    return -1;
+}
+
+int get_cached_jwks(const char *, char **, char **err_msg)
+{
+    *err_msg = strdup("scitokens-cpp has no keycache_get_cached_jwks");
+    return -1;
+}
+#endif
+
+}
+
+
+bool
+scitokens_xrootd::HasCachedKey(const std::string &issuer, const std::string &key_id)
+{
+    char *jwks = nullptr;
+    char *err_msg = nullptr;
+    if (get_cached_jwks(issuer.c_str(), &jwks, &err_msg)) {
+        free(err_msg);
+        return false;
+    }
+    picojson::value value;
+    bool parsed = picojson::parse(value, jwks).empty();
+    free(jwks);
+    if (!parsed || !value.is<picojson::value::object>()) {return false;}
+    const auto &object = value.get<picojson::value::object>();
+    auto iter = object.find("keys");
+    if (iter == object.end() || !iter->second.is<picojson::value::array>()) {return false;}
+    for (const auto &key : iter->second.get<picojson::value::array>()) {
+        if (!key.is<picojson::value::object>()) {continue;}
+        if (key_id.empty()) {return true;}
+        const auto &fields = key.get<picojson::value::object>();
+        auto kid = fields.find("kid");
+        if (kid != fields.end() && kid->second.is<std::string>() && kid->second.get<std::string>() == key_id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+KeyRefresher::KeyRefresher(XrdSysError &log, Metrics &metrics)
+    : m_log(log),
+      m_metrics(metrics)
+{}
+
+
+KeyRefresher::~KeyRefresher()
+{
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_shutdown = true;
+    }
+    m_cv.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+
+void
+KeyRefresher::start()
+{
+    m_thread = std::thread(&KeyRefresher::run, this);
+}
+
+
+void
+KeyRefresher::set_sources(const std::vector<KeySource> &sources, uint64_t refresh_secs)
+{
+    if (!g_have_keycache_api) {
+        m_log.Emsg("KeyRefresher", "This build of scitokens-cpp cannot prefetch keys or load jwks_file;"
+                   " keys will be fetched on demand.");
+        return;
+    }
+    // Only set_sources() writes the file stamps, so they are current.
+    std::unordered_map<KeySource, FileStamp, KeySourceHash> loaded;
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        for (const auto &state : m_states) {
+            if (!state.m_source.m_jwks_file.empty() && !state.m_failures) {
+                loaded.emplace(state.m_source, state.m_file);
+            }
+        }
+    }
+
+    std::vector<State> states;
+    std::vector<bool> unchanged;
+    states.reserve(sources.size());
+    for (const auto &source : sources) {
+        State state;
+        state.m_source = source;
+        bool keep = source.m_jwks_file.empty();
+        // Local files are cheap to read, so have their keys in place before
+        // the first request can ask for them.
+        if (!keep) {
+            state.m_file = stamp_file(source.m_jwks_file);
+            auto iter = loaded.find(source);
+            keep = iter != loaded.end() && iter->second == state.m_file;
+        }
+        if (!keep) {
+            state.m_next_refresh = monotonic_time() + refresh_secs;
+            if (!refresh(source)) {
+                state.m_next_refresh = monotonic_time() + m_min_retry_secs;
+                state.m_failures = 1;
+            }
+        }
+        states.push_back(state);
+        unchanged.push_back(keep);
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        std::unordered_map<KeySource, const State *, KeySourceHash> current;
+        for (const auto &state : m_states) {
+            current.emplace(state.m_source, &state);
+        }
+        // Issuers that were already configured keep their schedule.
+        for (size_t idx = 0; idx < states.size(); idx++) {
+            if (!unchanged[idx]) {continue;}
+            auto iter = current.find(states[idx].m_source);
+            if (iter != current.end()) {
+                states[idx] = *iter->second;
+            }
+        }
+        m_states = std::move(states);
+        m_refresh_secs = refresh_secs;
+    }
+    m_cv.notify_all();
+}
+
+
+KeyRefresher::FileStamp
+KeyRefresher::stamp_file(const std::string &path)
+{
+    FileStamp result;
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0) {
+        result.m_valid = true;
+        result.m_dev = st.st_dev;
+        result.m_ino = st.st_ino;
+        result.m_size = st.st_size;
+        result.m_mtime = st.st_mtim;
+    }
+    return result;
+}
+
+
+bool
+KeyRefresher::load_file(const KeySource &source)
+{
+    std::ifstream input(source.m_jwks_file);
+    std::stringstream contents;
+    contents << input.rdbuf();
+    if (!input) {
+        m_log.Emsg("KeyRefresher", "Unable to read JWKS file", source.m_jwks_file.c_str());
+        return false;
+    }
+    char *err_msg = nullptr;
+    if (set_jwks(source.m_issuer.c_str(), contents.str().c_str(), &err_msg)) {
+        m_log.Emsg("KeyRefresher", "Failed to load JWKS file", source.m_jwks_file.c_str(),
+                   err_msg ? err_msg : "unknown error");
+        free(err_msg);
+        return false;
+    }
+    return true;
+}
+
+
+bool
+KeyRefresher::refresh(const KeySource &source)
+{
+    bool success;
+    if (!source.m_jwks_file.empty()) {
+        success = load_file(source);
+    } else {
+        char *err_msg = nullptr;
+        success = !refresh_jwks(source.m_issuer.c_str(), &err_msg);
+        if (!success) {
+            m_log.Emsg("KeyRefresher", "Failed to refresh keys for issuer", source.m_issuer.c_str(),
+                       err_msg ? err_msg : "unknown error");
+            free(err_msg);
+        }
+    }
+    m_metrics.increment(success ? Counter::KeyRefresh : Counter::KeyRefreshFailed);
+    return success;
+}
+
+
+void
+KeyRefresher::run()
+{
+    std::unique_lock<std::mutex> guard(m_mutex);
+    while (!m_shutdown) {
+        uint64_t now = monotonic_time();
+        std::vector<KeySource> due;
+        uint64_t next_wakeup = UINT64_MAX;
+        if (m_refresh_secs) {
+            for (const auto &state : m_states) {
+                if (state.m_next_refresh <= now) {
+                    due.push_back(state.m_source);
+                } else {
+                    next_wakeup = std::min(next_wakeup, state.m_next_refresh);
+                }
+            }
+        }
+
+        if (due.empty()) {
+            if (next_wakeup == UINT64_MAX) {
+                m_cv.wait(guard);
+            } else {
+                m_cv.wait_for(guard, std::chrono::seconds(next_wakeup - now));
+            }
+            continue;
+        }
+
+        // Fetch without holding the lock so set_sources() never waits on
+        // the network.
+        guard.unlock();
+        std::vector<bool> results;
+        for (const auto &source : due) {
+            results.push_back(refresh(source));
+        }
+        guard.lock();
+
+        now = monotonic_time();
+        std::unordered_map<KeySource, State *, KeySourceHash> states;
+        for (auto &state : m_states) {
+            states.emplace(state.m_source, &state);
+        }
+        for (size_t idx = 0; idx < due.size(); idx++) {
+            auto entry = states.find(due[idx]);
+            if (entry == states.end()) {continue;}
+            auto iter = entry->second;
+            if (results[idx]) {
+                iter->m_failures = 0;
+                iter->m_next_refresh = now + m_refresh_secs;
+            } else {
+                auto backoff = m_min_retry_secs << std::min(iter->m_failures, 10u);
+                iter->m_failures++;
+                iter->m_next_refresh = now + std::min(backoff, m_refresh_secs);
+            }
+        }
+    }
+}
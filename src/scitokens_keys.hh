@@ -0,0 +1,122 @@
+#ifndef __SCITOKENS_KEYS_HH
+#define __SCITOKENS_KEYS_HH
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class XrdSysError;
+
+namespace scitokens_xrootd {
+
+class Metrics;
+
+// Where the public keys of one issuer come from: the issuer's own JWKS
+// endpoint, or a local JWKS file standing in for it.
+struct KeySource
+{
+    std::string m_issuer;
+    std::string m_jwks_file;
+
+    bool operator==(const KeySource &other) const {
+        return m_issuer == other.m_issuer && m_jwks_file == other.m_jwks_file;
+    }
+};
+
+struct KeySourceHash
+{
+    size_t operator()(const KeySource &source) const {
+        std::hash<std::string> hash;
+        return hash(source.m_issuer) * 31 + hash(source.m_jwks_file);
+    }
+};
+
+// Whether the scitokens-cpp key cache holds the key `key_id` of `issuer`, or
+// any key of it if `key_id` is empty.  Tells a token whose verification
+// failed with the issuer's keys at hand from one whose keys could not be
+// fetched.  Always false without the key cache API.
+bool HasCachedKey(const std::string &issuer, const std::string &key_id);
+
+// Keeps the scitokens-cpp key cache populated for every configured issuer.
+//
+// Left alone, scitokens-cpp fetches an issuer's keys lazily from inside
+// scitoken_deserialize, so the first request for a new issuer, and the first
+// one after the cached keys go stale, waits on an HTTPS round trip.  Instead,
+// a background thread fetches each issuer's keys as soon as it is configured
+// and refreshes them every `refresh_secs`, which must be shorter than the
+// key cache's own update interval for request threads never to fetch.
+// Failed fetches are retried with exponential backoff; the previously cached
+// keys remain in use meanwhile.
+class KeyRefresher
+{
+public:
+    KeyRefresher(XrdSysError &log, Metrics &metrics);
+    ~KeyRefresher();
+
+    KeyRefresher(const KeyRefresher &) = delete;
+    KeyRefresher &operator=(const KeyRefresher &) = delete;
+
+    // Replace the set of issuers to keep fresh.  Sources backed by a local
+    // file are loaded before returning, unless they were already loaded from
+    // the same, unmodified file; the rest are fetched by the background
+    // thread right away.  A `refresh_secs` of 0 disables background
+    // refreshes.
+    void set_sources(const std::vector<KeySource> &sources, uint64_t refresh_secs);
+
+    // Start the background thread; sources may be set before or after.
+    void start();
+
+private:
+    // Identifies a version of a JWKS file.
+    struct FileStamp
+    {
+        bool operator==(const FileStamp &other) const {
+            return m_valid && other.m_valid && m_dev == other.m_dev && m_ino == other.m_ino &&
+                m_size == other.m_size && m_mtime.tv_sec == other.m_mtime.tv_sec &&
+                m_mtime.tv_nsec == other.m_mtime.tv_nsec;
+        }
+
+        bool m_valid{false};
+        dev_t m_dev{0};
+        ino_t m_ino{0};
+        off_t m_size{0};
+        struct timespec m_mtime{0, 0};
+    };
+
+    struct State
+    {
+        KeySource m_source;
+        uint64_t m_next_refresh{0};
+        unsigned m_failures{0};
+        // Of the JWKS file when set_sources() last loaded it.
+        FileStamp m_file;
+    };
+
+    static FileStamp stamp_file(const std::string &path);
+
+    void run();
+    bool refresh(const KeySource &source);
+    bool load_file(const KeySource &source);
+
+    XrdSysError &m_log;
+    Metrics &m_metrics;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::vector<State> m_states;
+    uint64_t m_refresh_secs{0};
+    bool m_shutdown{false};
+    std::thread m_thread;
+
+    static constexpr uint64_t m_min_retry_secs = 10;
+};
+
+}
+
+#endif
@@ -0,0 +1,178 @@
+
+#include "scitokens_metrics.hh"
+
+#include <sstream>
+
+using namespace scitokens_xrootd;
+
+std::atomic<uint64_t> Metrics::m_instances{0};
+
+
+const char *
+Metrics::name(Counter counter)
+{
+    switch (counter) {
+        case Counter::CacheHit: return "cache_hit";
+        case Counter::CacheMiss: return "cache_miss";
+        case Counter::SharedCacheHit: return "shared_cache_hit";
+        case Counter::SharedCacheMiss: return "shared_cache_miss";
+        case Counter::BatchAccess: return "batch_access";
+        case Counter::NegativeHit: return "negative_cache_hit";
+        case Counter::ValidationWait: return "validation_wait";
+        case Counter::Validated: return "validated";
+        case Counter::RejectedMalformed: return "rejected_malformed";
+        case Counter::RejectedDeserialize: return "rejected_deserialize";
+        case Counter::RejectedExpired: return "rejected_expired";
+        case Counter::RejectedUnknownIssuer: return "rejected_unknown_issuer";
+        case Counter::RejectedAudience: return "rejected_audience";
+        case Counter::RejectedEnforcer: return "rejected_enforcer";
+        case Counter::RejectedAcls: return "rejected_acls";
+        case Counter::RejectedSubject: return "rejected_subject";
+        case Counter::RejectedException: return "rejected_exception";
+        case Counter::ChainFallback: return "chain_fallback";
+        case Counter::ChainCacheHit: return "chain_cache_hit";
+        case Counter::ChainCacheMiss: return "chain_cache_miss";
+        case Counter::VerifyRejected: return "verify_rejected";
+        case Counter::VerifyTimeout: return "verify_timeout";
+        case Counter::VerifyExpired: return "verify_expired";
+        case Counter::AuditWritten: return "audit_written";
+        case Counter::AuditDropped: return "audit_dropped";
+        case Counter::Reconfig: return "reconfig";
+        case Counter::ReconfigFailed: return "reconfig_failed";
+        case Counter::KeyRefresh: return "key_refresh";
+        case Counter::KeyRefreshFailed: return "key_refresh_failed";
+        case Counter::Count: break;
+    }
+    return "unknown";
+}
+
+
+const char *
+Metrics::name(Timer timer)
+{
+    switch (timer) {
+        case Timer::Validate: return "validate";
+        case Timer::Deserialize: return "deserialize";
+        case Timer::Enforcer: return "enforcer";
+        case Timer::AclMapping: return "acl_mapping";
+        case Timer::Reconfig: return "reconfig";
+        case Timer::Count: break;
+    }
+    return "unknown";
+}
+
+
+Metrics::ThreadBlock &
+Metrics::local()
+{
+    struct ThreadMetrics
+    {
+        uint64_t m_owner{0};
+        ThreadBlock *m_block{nullptr};
+    };
+    static thread_local ThreadMetrics thread_metrics;
+
+    if (thread_metrics.m_owner != m_id) {
+        // As in EpochDomain::local(), a thread alternating between instances
+        // finds its block again, so each instance holds one block per thread;
+        // one reusing the id of a thread that has exited adds to that
+        // thread's counts, which are still summed the same way.
+        auto self = std::this_thread::get_id();
+        std::lock_guard<std::mutex> guard(m_mutex);
+        ThreadBlock *found = nullptr;
+        for (const auto &block : m_blocks) {
+            if (block->m_thread == self) {
+                found = block.get();
+                break;
+            }
+        }
+        if (!found) {
+            m_blocks.emplace_back(new ThreadBlock());
+            found = m_blocks.back().get();
+            found->m_thread = self;
+        }
+        thread_metrics.m_block = found;
+        thread_metrics.m_owner = m_id;
+    }
+    return *thread_metrics.m_block;
+}
+
+
+void
+Metrics::record(Timer timer, std::chrono::steady_clock::duration elapsed)
+{
+    auto usec = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    uint64_t value = usec > 0 ? usec : 0;
+    unsigned bucket = 0;
+    while (bucket + 1 < m_bucket_count && (uint64_t(1) << bucket) < value) {bucket++;}
+
+    auto &data = local().m_timers[static_cast<unsigned>(timer)];
+    data.m_count.store(data.m_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    data.m_sum_us.store(data.m_sum_us.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    auto &count = data.m_buckets[bucket];
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+
+Metrics::Summary
+Metrics::snapshot() const
+{
+    Summary result;
+    std::lock_guard<std::mutex> guard(m_mutex);
+    for (const auto &block : m_blocks) {
+        for (unsigned idx = 0; idx < static_cast<unsigned>(Counter::Count); idx++) {
+            result.m_counters[idx] += block->m_counters[idx].load(std::memory_order_relaxed);
+        }
+        for (unsigned idx = 0; idx < static_cast<unsigned>(Timer::Count); idx++) {
+            const auto &data = block->m_timers[idx];
+            auto &summary = result.m_timers[idx];
+            summary.m_count += data.m_count.load(std::memory_order_relaxed);
+            summary.m_sum_us += data.m_sum_us.load(std::memory_order_relaxed);
+            for (unsigned bucket = 0; bucket < m_bucket_count; bucket++) {
+                summary.m_buckets[bucket] += data.m_buckets[bucket].load(std::memory_order_relaxed);
+            }
+        }
+    }
+    return result;
+}
+
+
+std::string
+Metrics::to_json(const Summary &summary, const std::vector<std::pair<std::string, uint64_t>> &gauges)
+{
+    std::stringstream ss;
+    ss << "{\"counters\": {";
+    for (unsigned idx = 0; idx < static_cast<unsigned>(Counter::Count); idx++) {
+        ss << (idx ? ", " : "") << "\"" << name(static_cast<Counter>(idx)) << "\": "
+           << summary.m_counters[idx];
+    }
+    ss << "}, \"gauges\": {";
+    bool first = true;
+    for (const auto &gauge : gauges) {
+        ss << (first ? "" : ", ") << "\"" << gauge.first << "\": " << gauge.second;
+        first = false;
+    }
+    // Each histogram lists [upper bound in microseconds, count] for its
+    // non-empty buckets; the last bucket is unbounded.
+    ss << "}, \"timers\": {";
+    for (unsigned idx = 0; idx < static_cast<unsigned>(Timer::Count); idx++) {
+        const auto &timer = summary.m_timers[idx];
+        ss << (idx ? ", " : "") << "\"" << name(static_cast<Timer>(idx)) << "\": {\"count\": "
+           << timer.m_count << ", \"sum_us\": " << timer.m_sum_us << ", \"buckets_us\": [";
+        first = true;
+        for (unsigned bucket = 0; bucket < m_bucket_count; bucket++) {
+            if (!timer.m_buckets[bucket]) {continue;}
+            ss << (first ? "" : ", ") << "[";
+            if (bucket + 1 < m_bucket_count) {
+                ss << (uint64_t(1) << bucket);
+            } else {
+                ss << "null";
+            }
+            ss << ", " << timer.m_buckets[bucket] << "]";
+            first = false;
+        }
+        ss << "]}";
+    }
+    ss << "}}";
+    return ss.str();
+}
@@ -0,0 +1,160 @@
+#ifndef __SCITOKENS_METRICS_HH
+#define __SCITOKENS_METRICS_HH
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace scitokens_xrootd {
+
+enum class Counter : unsigned
+{
+    CacheHit,
+    CacheMiss,
+    SharedCacheHit,
+    SharedCacheMiss,
+    BatchAccess,
+    NegativeHit,
+    ValidationWait,
+    Validated,
+    RejectedMalformed,
+    RejectedDeserialize,
+    RejectedExpired,
+    RejectedUnknownIssuer,
+    RejectedAudience,
+    RejectedEnforcer,
+    RejectedAcls,
+    RejectedSubject,
+    RejectedException,
+    ChainFallback,
+    ChainCacheHit,
+    ChainCacheMiss,
+    VerifyRejected,
+    VerifyTimeout,
+    VerifyExpired,
+    AuditWritten,
+    AuditDropped,
+    Reconfig,
+    ReconfigFailed,
+    KeyRefresh,
+    KeyRefreshFailed,
+    Count
+};
+
+enum class Timer : unsigned
+{
+    Validate,
+    Deserialize,
+    Enforcer,
+    AclMapping,
+    Reconfig,
+    Count
+};
+
+// Counters and latency histograms for the authorization plugin.
+//
+// Each thread updates its own block of counters, so recording is a plain
+// load/store on a cache line no other thread writes; only the first use by a
+// thread takes a lock, to register its block.  snapshot() sums all blocks.
+// Latencies go into log2 buckets of microseconds.
+class Metrics
+{
+public:
+    static constexpr unsigned m_bucket_count = 32;
+
+    struct TimerSummary
+    {
+        uint64_t m_count{0};
+        uint64_t m_sum_us{0};
+        uint64_t m_buckets[m_bucket_count]{};
+    };
+
+    struct Summary
+    {
+        uint64_t m_counters[static_cast<unsigned>(Counter::Count)]{};
+        TimerSummary m_timers[static_cast<unsigned>(Timer::Count)];
+    };
+
+    Metrics() : m_id(++m_instances) {}
+
+    Metrics(const Metrics &) = delete;
+    Metrics &operator=(const Metrics &) = delete;
+
+    void increment(Counter counter, uint64_t amount = 1) {
+        auto &value = local().m_counters[static_cast<unsigned>(counter)];
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    void record(Timer timer, std::chrono::steady_clock::duration elapsed);
+
+    Summary snapshot() const;
+
+    // Render `summary` and the given gauges as a single-line JSON object.
+    static std::string to_json(const Summary &summary,
+                               const std::vector<std::pair<std::string, uint64_t>> &gauges);
+
+    static const char *name(Counter counter);
+    static const char *name(Timer timer);
+
+private:
+    struct ThreadTimer
+    {
+        std::atomic<uint64_t> m_count{0};
+        std::atomic<uint64_t> m_sum_us{0};
+        std::atomic<uint64_t> m_buckets[m_bucket_count]{};
+    };
+
+    struct ThreadBlock
+    {
+        std::atomic<uint64_t> m_counters[static_cast<unsigned>(Counter::Count)]{};
+        ThreadTimer m_timers[static_cast<unsigned>(Timer::Count)];
+        std::thread::id m_thread;
+    };
+
+    ThreadBlock &local();
+
+    // Identifies this instance to the per-thread lookup in local(); unlike
+    // its address, an id is never reused by a later instance.
+    const uint64_t m_id;
+    static std::atomic<uint64_t> m_instances;
+
+    mutable std::mutex m_mutex;
+    // Freed with the instance; a thread's cached pointer to its block is
+    // never used again, as no later instance shares the id.
+    std::vector<std::unique_ptr<ThreadBlock>> m_blocks;
+};
+
+// Records the time from construction to destruction (or stop()) into `timer`.
+class ScopedTimer
+{
+public:
+    ScopedTimer(Metrics &metrics, Timer timer)
+        : m_metrics(metrics), m_timer(timer), m_start(std::chrono::steady_clock::now())
+    {}
+
+    ~ScopedTimer() {stop();}
+
+    void stop() {
+        if (m_running) {
+            m_running = false;
+            m_metrics.record(m_timer, std::chrono::steady_clock::now() - m_start);
+        }
+    }
+
+private:
+    Metrics &m_metrics;
+    const Timer m_timer;
+    const std::chrono::steady_clock::time_point m_start;
+    bool m_running{true};
+};
+
+}
+
+#endif
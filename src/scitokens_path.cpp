@@ -0,0 +1,69 @@
+
+#include "scitokens_path.hh"
+
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+
+
+size_t
+scitokens_xrootd::CanonicalizePath(char *path, size_t len)
+{
+    // path[0, out) holds the components kept so far, each after a slash.
+    // Every component read is preceded by at least one slash that is not
+    // copied, so writes never overtake reads.
+    size_t out = 0;
+    size_t in = 0;
+    while (in < len) {
+        while (in < len && path[in] == '/') {in++;}
+        size_t start = in;
+        while (in < len && path[in] != '/') {in++;}
+        size_t count = in - start;
+        if (!count || (count == 1 && path[start] == '.')) {continue;}
+        if (count == 2 && path[start] == '.' && path[start + 1] == '.') {
+            while (out && path[--out] != '/') {}
+            continue;
+        }
+        path[out++] = '/';
+        memmove(path + out, path + start, count);
+        out += count;
+    }
+    if (!out) {path[out++] = '/';}
+    return out;
+}
+
+
+bool
+scitokens_xrootd::MakeCanonical(const char *path, size_t len, std::string &result)
+{
+    if (!len || path[0] != '/') {return false;}
+    result.assign(path, len);
+    result.resize(CanonicalizePath(&result[0], len));
+    return true;
+}
+
+
+scitokens_xrootd::PathPrefixSet::PathPrefixSet(std::vector<std::string> paths)
+{
+    std::sort(paths.begin(), paths.end());
+    // After sorting, the paths having a given member as a prefix follow it.
+    for (auto &path : paths) {
+        if (!m_paths.empty() && !path.compare(0, m_paths.back().size(), m_paths.back())) {continue;}
+        m_paths.push_back(std::move(path));
+    }
+}
+
+
+bool
+scitokens_xrootd::PathPrefixSet::matches(const char *path, size_t len) const
+{
+    // The first member sorting after `path`.
+    auto iter = std::upper_bound(m_paths.begin(), m_paths.end(), std::make_pair(path, len),
+        [](const std::pair<const char *, size_t> &key, const std::string &member) {
+            return member.compare(0, std::string::npos, key.first, key.second) > 0;
+        });
+    if (iter == m_paths.begin()) {return false;}
+    --iter;
+    return iter->size() <= len && !memcmp(iter->data(), path, iter->size());
+}
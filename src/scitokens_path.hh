@@ -0,0 +1,69 @@
+#ifndef __SCITOKENS_PATH_HH
+#define __SCITOKENS_PATH_HH
+
+#include <stddef.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+namespace scitokens_xrootd {
+
+// Canonicalize the absolute path in the first `len` bytes of `path`, in
+// place: repeated and trailing slashes and "." components are dropped and
+// each ".." removes the component before it, stopping at the root.  Returns
+// the new length, which is never more than `len`; the root is "/".  The
+// path must start with '/'.
+size_t CanonicalizePath(char *path, size_t len);
+
+// Set `result` to the canonical form of `path`, reusing its storage.
+// Returns false if `path` is not absolute.
+bool MakeCanonical(const char *path, size_t len, std::string &result);
+
+inline bool MakeCanonical(const std::string &path, std::string &result)
+{
+    return MakeCanonical(path.data(), path.size(), result);
+}
+
+// Returns a path equivalent to the request path `path` with no "." or ".."
+// components, as XrdAccRules::apply() expects.  That is `path` itself when
+// it has none or is not absolute, else its canonical form stored in
+// `buffer`.
+inline const char *CanonicalRequestPath(const char *path, std::string &buffer)
+{
+    // Both kinds of component follow a slash; slashes alone need no work.
+    if (!path || path[0] != '/' || !strstr(path, "/.")) {return path;}
+    MakeCanonical(path, strlen(path), buffer);
+    return buffer.c_str();
+}
+
+// A set of paths that answers whether any of them is a prefix of a given
+// path, byte for byte as strncmp() would: "/a" is a prefix of "/ab".
+//
+// Paths with another member as a prefix are dropped, since they can never
+// change the answer, and the rest are kept sorted.  Then no two members are
+// prefixes of each other, so the only member that can be a prefix of a
+// path is the greatest one not after it: a lookup is a binary search and a
+// single comparison, however many paths there are.
+class PathPrefixSet
+{
+public:
+    PathPrefixSet() {}
+    explicit PathPrefixSet(std::vector<std::string> paths);
+
+    bool matches(const char *path, size_t len) const;
+
+    bool matches(const std::string &path) const {return matches(path.data(), path.size());}
+
+    bool empty() const {return m_paths.empty();}
+
+    // The members that remain, in order.
+    const std::vector<std::string> &paths() const {return m_paths;}
+
+private:
+    std::vector<std::string> m_paths;
+};
+
+}
+
+#endif
@@ -0,0 +1,349 @@
+
+#include "scitokens_rules.hh"
+
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+
+XrdAccPrivs AddPriv(Access_Operation op, XrdAccPrivs privs)
+{
+    int new_privs = privs;
+    switch (op) {
+        case AOP_Any:
+            break;
+        case AOP_Chmod:
+            new_privs |= static_cast<int>(XrdAccPriv_Chmod);
+            break;
+        case AOP_Chown:
+            new_privs |= static_cast<int>(XrdAccPriv_Chown);
+            break;
+        case AOP_Create:
+            new_privs |= static_cast<int>(XrdAccPriv_Create);
+            break;
+        case AOP_Delete:
+            new_privs |= static_cast<int>(XrdAccPriv_Delete);
+            break;
+        case AOP_Insert:
+            new_privs |= static_cast<int>(XrdAccPriv_Insert);
+            break;
+        case AOP_Lock:
+            new_privs |= static_cast<int>(XrdAccPriv_Lock);
+            break;
+        case AOP_Mkdir:
+            new_privs |= static_cast<int>(XrdAccPriv_Mkdir);
+            break;
+        case AOP_Read:
+            new_privs |= static_cast<int>(XrdAccPriv_Read);
+            break;
+        case AOP_Readdir:
+            new_privs |= static_cast<int>(XrdAccPriv_Readdir);
+            break;
+        case AOP_Rename:
+            new_privs |= static_cast<int>(XrdAccPriv_Rename);
+            break;
+        case AOP_Stat:
+            new_privs |= static_cast<int>(XrdAccPriv_Lookup);
+            break;
+        case AOP_Update:
+            new_privs |= static_cast<int>(XrdAccPriv_Update);
+            break;
+    };
+    return static_cast<XrdAccPrivs>(new_privs);
+}
+
+void put_u32(std::string &out, uint32_t value)
+{
+    out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+bool get_u32(const char *&data, const char *end, uint32_t &value)
+{
+    if (static_cast<size_t>(end - data) < sizeof(value)) {return false;}
+    memcpy(&value, data, sizeof(value));
+    data += sizeof(value);
+    return true;
+}
+
+void put_string(std::string &out, const std::string &value)
+{
+    put_u32(out, value.size());
+    out.append(value);
+}
+
+bool get_string(const char *&data, const char *end, std::string &value)
+{
+    uint32_t len;
+    if (!get_u32(data, end, len) || static_cast<size_t>(end - data) < len) {return false;}
+    value.assign(data, len);
+    data += len;
+    return true;
+}
+
+// Returns the length of the path component starting at `path`.
+inline size_t component_length(const char *path)
+{
+    const char *end = strchr(path, '/');
+    return end ? end - path : strlen(path);
+}
+
+// Returns the shared copy of `value`.  The pool only holds weak references;
+// it drops those of strings no longer in use whenever it has doubled in size
+// since the last sweep.
+std::shared_ptr<const std::string> intern(const std::string &value)
+{
+    static std::mutex mutex;
+    static std::unordered_map<std::string, std::weak_ptr<const std::string>> pool;
+    static size_t next_sweep = 64;
+
+    std::lock_guard<std::mutex> guard(mutex);
+    auto &entry = pool[value];
+    auto result = entry.lock();
+    if (!result) {
+        result = std::make_shared<const std::string>(value);
+        entry = result;
+    }
+    if (pool.size() >= next_sweep) {
+        for (auto iter = pool.begin(); iter != pool.end(); ) {
+            if (iter->second.expired()) {
+                iter = pool.erase(iter);
+            } else {
+                ++iter;
+            }
+        }
+        next_sweep = std::max<size_t>(64, 2 * pool.size());
+    }
+    return result;
+}
+
+}
+
+
+XrdAccRules::XrdAccRules(const std::string &username, const std::string &issuer, const std::string &subject) :
+    m_username(intern(username)),
+    m_issuer(intern(issuer)),
+    m_subject(intern(subject))
+{}
+
+
+void
+XrdAccRules::parse(const AccessRulesRaw &rules)
+{
+    // Build a conventional trie first, then lay it out breadth-first.
+    struct BuildNode
+    {
+        uint32_t m_privs{XrdAccPriv_None};
+        std::map<std::string, size_t> m_children;
+    };
+    std::vector<BuildNode> trie(1);
+    for (const auto &entry : rules) {
+        const char *path = entry.second.c_str();
+        if (*path != '/') {continue;}
+
+        size_t node = 0;
+        while (true) {
+            while (*path == '/') {path++;}
+            if (!*path) {break;}
+            auto len = component_length(path);
+            auto result = trie[node].m_children.emplace(std::string(path, len), trie.size());
+            node = result.first->second;
+            if (result.second) {trie.emplace_back();}
+            path += len;
+        }
+        trie[node].m_privs = AddPriv(entry.first, static_cast<XrdAccPrivs>(trie[node].m_privs));
+    }
+
+    m_nodes.assign(trie.size(), Node());
+    m_names.clear();
+    std::vector<size_t> order{0};
+    order.reserve(trie.size());
+    for (size_t idx = 0; idx < order.size(); idx++) {
+        auto &source = trie[order[idx]];
+        auto &node = m_nodes[idx];
+        node.m_privs = source.m_privs;
+        node.m_first_child = order.size();
+        node.m_child_count = source.m_children.size();
+        for (const auto &entry : source.m_children) {
+            // Push each node's privileges down to its whole subtree.
+            trie[entry.second].m_privs |= source.m_privs;
+            auto &child = m_nodes[order.size()];
+            child.m_name = m_names.size();
+            child.m_name_length = entry.first.size();
+            m_names += entry.first;
+            order.push_back(entry.second);
+        }
+    }
+    m_names.shrink_to_fit();
+}
+
+
+unsigned
+XrdAccRules::child(unsigned node, const char *component, size_t len) const
+{
+    const auto &parent = m_nodes[node];
+    auto begin = m_nodes.begin() + parent.m_first_child;
+    auto end = begin + parent.m_child_count;
+    const char *names = m_names.data();
+    auto iter = std::lower_bound(begin, end, std::make_pair(component, len),
+        [&](const Node &entry, const std::pair<const char *, size_t> &key) {
+            auto result = memcmp(names + entry.m_name, key.first, std::min<size_t>(entry.m_name_length, key.second));
+            return result ? result < 0 : entry.m_name_length < key.second;
+        });
+    if (iter != end && iter->m_name_length == len && !memcmp(names + iter->m_name, component, len)) {
+        return iter - m_nodes.begin();
+    }
+    return 0;
+}
+
+
+XrdAccPrivs
+XrdAccRules::apply(Access_Operation, const char *path) const
+{
+    if (m_nodes.empty() || !path || *path != '/') {return XrdAccPriv_None;}
+
+    unsigned node = 0;
+    while (true) {
+        while (*path == '/') {path++;}
+        if (!*path) {break;}
+        auto len = component_length(path);
+        auto next = child(node, path, len);
+        if (!next) {break;}
+        node = next;
+        path += len;
+    }
+    return static_cast<XrdAccPrivs>(m_nodes[node].m_privs);
+}
+
+
+void
+XrdAccRules::apply(const char *const *paths, size_t count, XrdAccPrivs *privs) const
+{
+    // steps[i] is the node reached after consuming the first m_end bytes of
+    // the previous path; steps[0] is the root.  A final dead step records
+    // that the component ending at m_end matched nothing below m_node.
+    struct Step
+    {
+        size_t m_end;
+        unsigned m_node;
+        bool m_dead;
+    };
+    std::vector<Step> steps{{0, 0, false}};
+    const char *previous = "";
+    for (size_t idx = 0; idx < count; idx++) {
+        const char *path = paths[idx];
+        if (m_nodes.empty() || !path || *path != '/') {
+            privs[idx] = XrdAccPriv_None;
+            continue;
+        }
+        // A step is shared if this path has the same bytes up to its end and
+        // its component ends there too.  strncmp() stops at the end of a
+        // shorter path.
+        while (steps.size() > 1) {
+            auto end = steps.back().m_end;
+            if (!strncmp(path, previous, end) && (path[end] == '/' || path[end] == '\0')) {break;}
+            steps.pop_back();
+        }
+        previous = path;
+
+        unsigned node = steps.back().m_node;
+        if (steps.back().m_dead) {
+            privs[idx] = static_cast<XrdAccPrivs>(m_nodes[node].m_privs);
+            continue;
+        }
+        const char *cursor = path + steps.back().m_end;
+        while (true) {
+            while (*cursor == '/') {cursor++;}
+            if (!*cursor) {break;}
+            auto len = component_length(cursor);
+            auto next = child(node, cursor, len);
+            cursor += len;
+            if (!next) {
+                steps.push_back(Step{static_cast<size_t>(cursor - path), node, true});
+                break;
+            }
+            node = next;
+            steps.push_back(Step{static_cast<size_t>(cursor - path), node, false});
+        }
+        privs[idx] = static_cast<XrdAccPrivs>(m_nodes[node].m_privs);
+    }
+}
+
+
+size_t
+XrdAccRules::memory_usage() const
+{
+    return sizeof(*this) + m_nodes.capacity() * sizeof(Node) + m_names.capacity();
+}
+
+
+void
+XrdAccRules::serialize(std::string &out) const
+{
+    // The child ranges are implied by the breadth-first order.
+    put_string(out, *m_username);
+    put_string(out, *m_issuer);
+    put_string(out, *m_subject);
+    put_u32(out, m_nodes.size());
+    put_string(out, m_names);
+    for (const auto &node : m_nodes) {
+        put_u32(out, node.m_name);
+        put_u32(out, node.m_name_length);
+        put_u32(out, node.m_child_count);
+        put_u32(out, node.m_privs);
+    }
+}
+
+
+std::shared_ptr<XrdAccRules>
+XrdAccRules::deserialize(const char *&data, const char *end)
+{
+    std::string username, issuer, subject;
+    uint32_t node_count;
+    if (!get_string(data, end, username) || !get_string(data, end, issuer) || !get_string(data, end, subject) ||
+        !get_u32(data, end, node_count))
+    {
+        return nullptr;
+    }
+
+    std::shared_ptr<XrdAccRules> rules(new XrdAccRules(username, issuer, subject));
+    if (!get_string(data, end, rules->m_names)) {return nullptr;}
+    // Each node takes sixteen bytes, so a corrupt count cannot make us
+    // reserve more than the input could describe.
+    if (node_count > static_cast<size_t>(end - data) / 16) {return nullptr;}
+    rules->m_nodes.resize(node_count);
+    // apply() and child() rely on the nodes forming a tree laid out
+    // breadth-first, with siblings sorted and names inside m_names.
+    uint64_t next_child = 1;
+    const char *names = rules->m_names.data();
+    for (uint32_t idx = 0; idx < node_count; idx++) {
+        auto &node = rules->m_nodes[idx];
+        if (!get_u32(data, end, node.m_name) || !get_u32(data, end, node.m_name_length) ||
+            !get_u32(data, end, node.m_child_count) || !get_u32(data, end, node.m_privs))
+        {
+            return nullptr;
+        }
+        if (static_cast<uint64_t>(node.m_name) + node.m_name_length > rules->m_names.size() ||
+            (idx && idx >= next_child) || (!idx && node.m_name_length))
+        {
+            return nullptr;
+        }
+        node.m_first_child = next_child;
+        next_child += node.m_child_count;
+        if (next_child > node_count) {return nullptr;}
+    }
+    if (node_count && next_child != node_count) {return nullptr;}
+    for (const auto &node : rules->m_nodes) {
+        for (uint32_t idx = 1; idx < node.m_child_count; idx++) {
+            const auto &left = rules->m_nodes[node.m_first_child + idx - 1];
+            const auto &right = rules->m_nodes[node.m_first_child + idx];
+            auto result = memcmp(names + left.m_name, names + right.m_name,
+                                 std::min(left.m_name_length, right.m_name_length));
+            if (result > 0 || (!result && left.m_name_length >= right.m_name_length)) {return nullptr;}
+        }
+    }
+    return rules;
+}
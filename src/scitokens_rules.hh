@@ -0,0 +1,124 @@
+#ifndef __SCITOKENS_RULES_HH
+#define __SCITOKENS_RULES_HH
+
+#include "XrdAcc/XrdAccAuthorize.hh"
+
+#include <stdint.h>
+#include <time.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace scitokens_xrootd {
+
+inline uint64_t monotonic_time() {
+  struct timespec tp;
+#ifdef CLOCK_MONOTONIC_COARSE
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &tp);
+#else
+  clock_gettime(CLOCK_MONOTONIC, &tp);
+#endif
+  return tp.tv_sec + (tp.tv_nsec >= 500000000);
+}
+
+// The same clock in milliseconds, for deadlines that need to be precise.
+inline uint64_t monotonic_time_ms() {
+  struct timespec tp;
+#ifdef CLOCK_MONOTONIC_COARSE
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &tp);
+#else
+  clock_gettime(CLOCK_MONOTONIC, &tp);
+#endif
+  return static_cast<uint64_t>(tp.tv_sec) * 1000 + tp.tv_nsec / 1000000;
+}
+
+// Wall-clock milliseconds, for converting token and cache file timestamps to
+// and from the monotonic clock.
+inline int64_t wall_time_ms() {
+  struct timespec tp;
+  clock_gettime(CLOCK_REALTIME, &tp);
+  return static_cast<int64_t>(tp.tv_sec) * 1000 + tp.tv_nsec / 1000000;
+}
+
+}
+
+typedef std::vector<std::pair<Access_Operation, std::string>> AccessRulesRaw;
+
+
+// The authorizations granted by one token.
+//
+// The (operation, path prefix) pairs are compiled into a trie keyed on path
+// components; each node carries the union of the privileges granted at it
+// and at all of its ancestors, so apply() walks the request path once and
+// returns the full privilege mask of the deepest node reached.  Prefixes
+// only match on a '/' boundary: a rule for /stash/user covers
+// /stash/user and /stash/user/file but not /stash/username.
+//
+// The trie is stored flat, in two allocations: the nodes in breadth-first
+// order, so the children of a node are adjacent and sorted by name, and all
+// component names back to back in one string.  Rules repeating a prefix,
+// such as the read and stat rules of one scope, share its node.  The
+// username, and the issuer and subject of the token kept for the audit log,
+// are interned, so tokens of one user share a single copy of each.
+class XrdAccRules
+{
+public:
+    // Expiry is tracked by the cache entry holding the rules.
+    explicit XrdAccRules(const std::string &username, const std::string &issuer = "",
+                         const std::string &subject = "");
+
+    ~XrdAccRules() {}
+
+    XrdAccPrivs apply(Access_Operation, const char *path) const;
+
+    // Set privs[i] to apply(paths[i]) for each of the `count` paths.  Each
+    // path resumes the walk from the deepest node it shares with the one
+    // before it, so the entries of one directory only walk their last
+    // component, or none if the directory is already past the rules.
+    void apply(const char *const *paths, size_t count, XrdAccPrivs *privs) const;
+
+    void parse(const AccessRulesRaw &rules);
+
+    const std::string & get_username() const {return *m_username;}
+
+    // Shared, so the audit log can hold them past the cache entry.
+    const std::shared_ptr<const std::string> & get_issuer() const {return m_issuer;}
+    const std::shared_ptr<const std::string> & get_subject() const {return m_subject;}
+
+    // Approximate heap and object footprint of these rules, in bytes, not
+    // counting the shared strings.
+    size_t memory_usage() const;
+
+    // Append a binary encoding of the identity and compiled rules to `out`.
+    // The encoding uses the host's byte order and is only meant to be read
+    // back by deserialize() on the same kind of machine.
+    void serialize(std::string &out) const;
+
+    // Decode rules written by serialize() starting at `data`, advancing it
+    // past them.  Returns nullptr if [data, end) does not hold well-formed
+    // rules.
+    static std::shared_ptr<XrdAccRules> deserialize(const char *&data, const char *end);
+
+private:
+    struct Node
+    {
+        // The component leading to this node, as a range of m_names.
+        uint32_t m_name;
+        uint32_t m_name_length;
+        uint32_t m_first_child;
+        uint32_t m_child_count;
+        uint32_t m_privs;
+    };
+
+    unsigned child(unsigned node, const char *component, size_t len) const;
+
+    std::vector<Node> m_nodes;
+    std::string m_names;
+    std::shared_ptr<const std::string> m_username;
+    std::shared_ptr<const std::string> m_issuer;
+    std::shared_ptr<const std::string> m_subject;
+};
+
+#endif
@@ -0,0 +1,107 @@
+
+#include "scitokens_sha256.hh"
+
+#include <stdint.h>
+#include <string.h>
+
+using namespace scitokens_xrootd;
+
+namespace {
+
+// FIPS 180-4, section 4.2.2.
+const uint32_t g_round_constants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+inline uint32_t rotate_right(uint32_t value, unsigned bits)
+{
+    return (value >> bits) | (value << (32 - bits));
+}
+
+inline uint32_t load_big_endian(const unsigned char *bytes)
+{
+    return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) | bytes[3];
+}
+
+inline void store_big_endian(unsigned char *bytes, uint32_t value)
+{
+    bytes[0] = value >> 24;
+    bytes[1] = value >> 16;
+    bytes[2] = value >> 8;
+    bytes[3] = value;
+}
+
+// Fold one 64-byte block into `state`.
+void compress(uint32_t *state, const unsigned char *block)
+{
+    uint32_t schedule[64];
+    for (unsigned idx = 0; idx < 16; idx++) {
+        schedule[idx] = load_big_endian(block + 4 * idx);
+    }
+    for (unsigned idx = 16; idx < 64; idx++) {
+        uint32_t low = schedule[idx - 15];
+        uint32_t high = schedule[idx - 2];
+        uint32_t sigma0 = rotate_right(low, 7) ^ rotate_right(low, 18) ^ (low >> 3);
+        uint32_t sigma1 = rotate_right(high, 17) ^ rotate_right(high, 19) ^ (high >> 10);
+        schedule[idx] = schedule[idx - 16] + sigma0 + schedule[idx - 7] + sigma1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (unsigned idx = 0; idx < 64; idx++) {
+        uint32_t sum1 = rotate_right(e, 6) ^ rotate_right(e, 11) ^ rotate_right(e, 25);
+        uint32_t choice = (e & f) ^ (~e & g);
+        uint32_t temp1 = h + sum1 + choice + g_round_constants[idx] + schedule[idx];
+        uint32_t sum0 = rotate_right(a, 2) ^ rotate_right(a, 13) ^ rotate_right(a, 22);
+        uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t temp2 = sum0 + majority;
+        h = g;
+        g = f;
+        f = e;
+        e = d + temp1;
+        d = c;
+        c = b;
+        b = a;
+        a = temp1 + temp2;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+}
+
+
+void
+scitokens_xrootd::Sha256(const void *data, size_t len, unsigned char *digest)
+{
+    uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                         0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    auto bytes = static_cast<const unsigned char *>(data);
+    size_t remaining = len;
+    for (; remaining >= 64; bytes += 64, remaining -= 64) {
+        compress(state, bytes);
+    }
+
+    // The final one or two blocks: the tail, a single 1 bit, zeros and the
+    // message length in bits.
+    unsigned char tail[128] = {};
+    memcpy(tail, bytes, remaining);
+    tail[remaining] = 0x80;
+    size_t tail_len = remaining < 56 ? 64 : 128;
+    uint64_t bits = uint64_t(len) * 8;
+    store_big_endian(tail + tail_len - 8, bits >> 32);
+    store_big_endian(tail + tail_len - 4, static_cast<uint32_t>(bits));
+    compress(state, tail);
+    if (tail_len == 128) {compress(state, tail + 64);}
+
+    for (unsigned idx = 0; idx < 8; idx++) {
+        store_big_endian(digest + 4 * idx, state[idx]);
+    }
+}
@@ -0,0 +1,19 @@
+#ifndef __SCITOKENS_SHA256_HH
+#define __SCITOKENS_SHA256_HH
+
+#include <stddef.h>
+
+namespace scitokens_xrootd {
+
+// Write the SHA-256 of the first `len` bytes of `data` to the 32 bytes at
+// `digest`.
+//
+// Used on the cache-hit path in place of OpenSSL's SHA256(), which on
+// OpenSSL 3 fetches the digest from a provider and allocates a context on
+// every call.  This one works entirely on the stack: it never allocates,
+// locks or writes to memory shared with other threads.
+void Sha256(const void *data, size_t len, unsigned char *digest);
+
+}
+
+#endif
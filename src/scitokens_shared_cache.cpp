@@ -0,0 +1,257 @@
+
+#include "scitokens_shared_cache.hh"
+#include "scitokens_rules.hh"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+using namespace scitokens_xrootd;
+
+namespace {
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "The shared cache needs address-free 64-bit atomics");
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t), "Slots are arrays of 64-bit words");
+
+const char g_magic[8] = {'X', 'S', 'T', 'S', 'H', 'A', 'R', 'E'};
+const uint32_t g_version = 2;
+
+// Slots start one page into the file.
+const size_t g_header_bytes = 4096;
+
+struct FileHeader
+{
+    char m_magic[8];
+    uint32_t m_version;
+    // Detects a file created on a machine with a different byte order.
+    uint32_t m_byte_order;
+    uint64_t m_slot_count;
+    uint64_t m_slot_words;
+};
+
+// Word offsets within a slot.  The expiry is in wall-clock milliseconds and
+// zero for a slot never written; the length is that of the serialized rules.
+enum SlotWord : size_t
+{
+    Sequence = 0,
+    Digest = 1,
+    ConfigHash = 5,
+    Expiry = 6,
+    Length = 7,
+    Data = 8
+};
+
+size_t next_power_of_two(size_t value)
+{
+    size_t result = 1;
+    while (result < value) {result <<= 1;}
+    return result;
+}
+
+}
+
+
+constexpr size_t SharedTokenCache::m_slot_words;
+constexpr size_t SharedTokenCache::m_max_rules_bytes;
+constexpr size_t SharedTokenCache::m_ways;
+
+
+SharedTokenCache::SharedTokenCache(const std::string &path, void *map, size_t map_bytes, size_t slot_count)
+    : m_path(path),
+      m_map(map),
+      m_map_bytes(map_bytes),
+      m_slot_mask(slot_count - 1)
+{}
+
+
+SharedTokenCache::~SharedTokenCache()
+{
+    munmap(m_map, m_map_bytes);
+}
+
+
+std::unique_ptr<SharedTokenCache>
+SharedTokenCache::open(const std::string &path, size_t slot_count, std::string &err)
+{
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | O_NOFOLLOW, 0600);
+    if (fd < 0) {
+        err = "Unable to open " + path + ": " + strerror(errno);
+        return nullptr;
+    }
+    // Serializes creation against the other processes opening the file.
+    if (flock(fd, LOCK_EX)) {
+        err = "Unable to lock " + path + ": " + strerror(errno);
+        close(fd);
+        return nullptr;
+    }
+    // The mapping holds a reference to the open file, so closing the
+    // descriptor alone would not release the lock.
+    auto finish = [&]() {
+        flock(fd, LOCK_UN);
+        close(fd);
+    };
+    auto fail = [&](const std::string &message) -> std::unique_ptr<SharedTokenCache> {
+        err = message;
+        finish();
+        return nullptr;
+    };
+
+    struct stat st;
+    if (fstat(fd, &st)) {
+        return fail("Unable to stat " + path + ": " + strerror(errno));
+    }
+    if (st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH))) {
+        return fail("Ignoring " + path + ": it must be owned by this user and writable by no one else");
+    }
+
+    // The header is written last, so a file without one was never used and
+    // its size is ours to choose.
+    FileHeader header;
+    memset(&header, 0, sizeof(header));
+    if (st.st_size > 0 && pread(fd, &header, sizeof(header), 0) != sizeof(header)) {
+        return fail("Ignoring " + path + ": file is truncated");
+    }
+    static const char unset[sizeof(g_magic)] = {};
+    if (!memcmp(header.m_magic, unset, sizeof(unset))) {
+        memcpy(header.m_magic, g_magic, sizeof(g_magic));
+        header.m_version = g_version;
+        header.m_byte_order = 0x01020304;
+        header.m_slot_count = next_power_of_two(std::max(slot_count, m_ways));
+        header.m_slot_words = m_slot_words;
+        auto bytes = g_header_bytes + header.m_slot_count * m_slot_words * sizeof(uint64_t);
+        if (ftruncate(fd, 0) || ftruncate(fd, bytes) ||
+            pwrite(fd, &header, sizeof(header), 0) != sizeof(header))
+        {
+            return fail("Unable to initialize " + path + ": " + strerror(errno));
+        }
+    }
+    // Another process may have created the file with a different size; its
+    // layout is the one in use.
+    if (memcmp(header.m_magic, g_magic, sizeof(g_magic)) || header.m_version != g_version ||
+        header.m_byte_order != 0x01020304 || header.m_slot_words != m_slot_words ||
+        header.m_slot_count < m_ways || (header.m_slot_count & (header.m_slot_count - 1)))
+    {
+        return fail("Ignoring " + path + ": not a shared cache written by this version");
+    }
+    auto map_bytes = g_header_bytes + header.m_slot_count * m_slot_words * sizeof(uint64_t);
+    if (fstat(fd, &st) || static_cast<size_t>(st.st_size) != map_bytes) {
+        return fail("Ignoring " + path + ": file size does not match its header");
+    }
+
+    void *map = mmap(nullptr, map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        return fail("Unable to map " + path + ": " + strerror(errno));
+    }
+    finish();
+    return std::unique_ptr<SharedTokenCache>(new SharedTokenCache(path, map, map_bytes, header.m_slot_count));
+}
+
+
+std::atomic<uint64_t> *
+SharedTokenCache::slot(size_t idx) const
+{
+    return reinterpret_cast<std::atomic<uint64_t> *>(static_cast<char *>(m_map) + g_header_bytes) +
+        idx * m_slot_words;
+}
+
+
+std::shared_ptr<XrdAccRules>
+SharedTokenCache::get(const TokenDigest &digest, uint64_t config_hash, int64_t now_ms, int64_t &expiry_ms) const
+{
+    std::vector<uint64_t> words;
+    auto base = digest.m_words[2];
+    for (size_t way = 0; way < m_ways; way++) {
+        auto words_in = slot((base + way) & m_slot_mask);
+        // Retry once if a writer got in the way.
+        for (unsigned attempt = 0; attempt < 2; attempt++) {
+            auto sequence = words_in[Sequence].load(std::memory_order_acquire);
+            if (sequence & 1) {break;}
+            bool match = words_in[ConfigHash].load(std::memory_order_relaxed) == config_hash;
+            for (unsigned idx = 0; match && idx < 4; idx++) {
+                match = words_in[Digest + idx].load(std::memory_order_relaxed) == digest.m_words[idx];
+            }
+            int64_t expiry = words_in[Expiry].load(std::memory_order_relaxed);
+            auto length = words_in[Length].load(std::memory_order_relaxed);
+            if (!match || expiry <= now_ms || length > m_max_rules_bytes) {
+                // What was read may be torn by a writer; move on only if
+                // the slot was stable throughout.
+                if (words_in[Sequence].load(std::memory_order_acquire) == sequence) {break;}
+                continue;
+            }
+            words.resize((length + 7) / 8);
+            for (size_t idx = 0; idx < words.size(); idx++) {
+                words[idx] = words_in[Data + idx].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (words_in[Sequence].load(std::memory_order_relaxed) != sequence) {continue;}
+
+            auto data = reinterpret_cast<const char *>(words.data());
+            auto rules = XrdAccRules::deserialize(data, data + length);
+            if (!rules) {break;}
+            expiry_ms = expiry;
+            return rules;
+        }
+    }
+    return nullptr;
+}
+
+
+bool
+SharedTokenCache::put(const TokenDigest &digest, uint64_t config_hash, int64_t expiry_ms, const XrdAccRules &rules)
+{
+    std::string bytes;
+    rules.serialize(bytes);
+    if (bytes.size() > m_max_rules_bytes) {return false;}
+
+    // The slot already holding this token, else the one expiring first.
+    auto base = digest.m_words[2];
+    std::atomic<uint64_t> *victim = nullptr;
+    uint64_t victim_expiry = UINT64_MAX;
+    for (size_t way = 0; way < m_ways; way++) {
+        auto words = slot((base + way) & m_slot_mask);
+        if (words[Sequence].load(std::memory_order_relaxed) & 1) {continue;}
+        bool match = words[ConfigHash].load(std::memory_order_relaxed) == config_hash;
+        for (unsigned idx = 0; match && idx < 4; idx++) {
+            match = words[Digest + idx].load(std::memory_order_relaxed) == digest.m_words[idx];
+        }
+        auto expiry = words[Expiry].load(std::memory_order_relaxed);
+        if (match) {
+            victim = words;
+            break;
+        }
+        if (expiry < victim_expiry) {
+            victim = words;
+            victim_expiry = expiry;
+        }
+    }
+    if (!victim) {return false;}
+
+    // Claim the slot; lose gracefully to any other writer.
+    auto sequence = victim[Sequence].load(std::memory_order_relaxed);
+    if ((sequence & 1) ||
+        !victim[Sequence].compare_exchange_strong(sequence, sequence + 1, std::memory_order_relaxed))
+    {
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    for (unsigned idx = 0; idx < 4; idx++) {
+        victim[Digest + idx].store(digest.m_words[idx], std::memory_order_relaxed);
+    }
+    victim[ConfigHash].store(config_hash, std::memory_order_relaxed);
+    victim[Expiry].store(expiry_ms, std::memory_order_relaxed);
+    victim[Length].store(bytes.size(), std::memory_order_relaxed);
+    for (size_t offset = 0; offset < bytes.size(); offset += 8) {
+        uint64_t word = 0;
+        memcpy(&word, bytes.data() + offset, std::min<size_t>(8, bytes.size() - offset));
+        victim[Data + offset / 8].store(word, std::memory_order_relaxed);
+    }
+    victim[Sequence].store(sequence + 2, std::memory_order_release);
+    return true;
+}
@@ -0,0 +1,86 @@
+#ifndef __SCITOKENS_SHARED_CACHE_HH
+#define __SCITOKENS_SHARED_CACHE_HH
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "scitokens_cache.hh"
+
+class XrdAccRules;
+
+namespace scitokens_xrootd {
+
+// Validated-token cache shared by every xrootd process on the host which
+// names the same file, so a token verified by one of them is not verified
+// again by the others.
+//
+// The file is mapped into each process and holds a fixed number of
+// fixed-size slots, each protected by a sequence lock: a writer makes the
+// sequence odd, stores the entry and makes it even again, and a reader
+// retries or gives up if the sequence was odd or changed while it copied the
+// entry out.  Every field is accessed as an atomic word, so neither side
+// ever blocks the other and a process that dies mid-write can only lose the
+// slot it held.  A token may be stored in any of the few slots following its
+// hash; the write replaces the oldest of them.
+//
+// Entries hold the compiled rules in their XrdAccRules::serialize() form and
+// are keyed by the token digest and the hash of the configuration they were
+// derived from, so processes configured differently never share rules.
+// Rules too large for a slot are not shared.  Expiries are wall-clock times,
+// as the file may outlive the processes using it.
+//
+// Since the file grants access to whoever holds a matching token, it is only
+// used if it is owned by the current user and writable by no one else.
+class SharedTokenCache
+{
+public:
+    ~SharedTokenCache();
+
+    SharedTokenCache(const SharedTokenCache &) = delete;
+    SharedTokenCache &operator=(const SharedTokenCache &) = delete;
+
+    // Map the cache in `path`, creating it with room for `slot_count` entries
+    // if it does not exist.  Returns nullptr and sets `err` on failure,
+    // including when another process created it with a different size.
+    static std::unique_ptr<SharedTokenCache> open(const std::string &path, size_t slot_count,
+                                                  std::string &err);
+
+    // Returns the rules stored for `digest` under `config_hash` if they are
+    // still valid at the wall-clock time `now_ms`, setting `expiry_ms` to when
+    // they expire; nullptr otherwise.
+    std::shared_ptr<XrdAccRules> get(const TokenDigest &digest, uint64_t config_hash, int64_t now_ms,
+                                     int64_t &expiry_ms) const;
+
+    // Store `rules` for `digest` until `expiry_ms`.  Returns false if they
+    // were not stored: they do not fit in a slot, or every candidate slot is
+    // being written by another process.
+    bool put(const TokenDigest &digest, uint64_t config_hash, int64_t expiry_ms, const XrdAccRules &rules);
+
+    const std::string &path() const {return m_path;}
+    size_t slot_count() const {return m_slot_mask + 1;}
+
+    // Words per slot, including the header words below.
+    static constexpr size_t m_slot_words = 256;
+    static constexpr size_t m_max_rules_bytes = (m_slot_words - 8) * 8;
+
+private:
+    SharedTokenCache(const std::string &path, void *map, size_t map_bytes, size_t slot_count);
+
+    std::atomic<uint64_t> *slot(size_t idx) const;
+
+    // Slots a token may occupy, starting from its hash.
+    static constexpr size_t m_ways = 4;
+
+    const std::string m_path;
+    void *const m_map;
+    const size_t m_map_bytes;
+    const size_t m_slot_mask;
+};
+
+}
+
+#endif
@@ -0,0 +1,69 @@
+
+#include "scitokens_workers.hh"
+#include "scitokens_rules.hh"
+
+using namespace scitokens_xrootd;
+
+
+WorkerPool::WorkerPool(unsigned threads, size_t max_queued)
+    : m_max_queued(max_queued)
+{
+    m_threads.reserve(threads);
+    for (unsigned idx = 0; idx < threads; idx++) {
+        m_threads.emplace_back(&WorkerPool::run, this);
+    }
+}
+
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_shutdown = true;
+    }
+    m_cv.notify_all();
+    for (auto &thread : m_threads) {
+        thread.join();
+    }
+}
+
+
+bool
+WorkerPool::submit(Task task, uint64_t deadline)
+{
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        if (m_shutdown || m_queue.size() >= m_max_queued) {return false;}
+        m_queue.push_back(Item{std::move(task), deadline});
+    }
+    m_cv.notify_one();
+    return true;
+}
+
+
+size_t
+WorkerPool::queued() const
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_queue.size();
+}
+
+
+void
+WorkerPool::run()
+{
+    std::unique_lock<std::mutex> guard(m_mutex);
+    while (true) {
+        m_cv.wait(guard, [&]{return m_shutdown || !m_queue.empty();});
+        if (m_queue.empty()) {return;}
+        auto item = std::move(m_queue.front());
+        m_queue.pop_front();
+        bool expired = m_shutdown || monotonic_time_ms() > item.m_deadline;
+        guard.unlock();
+        // A task that throws loses only its own result, not the thread.
+        try {
+            item.m_task(expired);
+        } catch (...) {}
+        guard.lock();
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef __SCITOKENS_WORKERS_HH
+#define __SCITOKENS_WORKERS_HH
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace scitokens_xrootd {
+
+// A fixed set of threads running tasks from a bounded queue, so the threads
+// submitting work never do it themselves and never queue it without limit.
+//
+// Each task carries a deadline in the milliseconds of monotonic_time_ms().
+// A task still queued at its deadline is not worth running any more, as
+// whoever submitted it has stopped waiting; it is called with `expired` set
+// so it can release what it holds, and the same happens to every task still
+// queued when the pool is destroyed.
+class WorkerPool
+{
+public:
+    typedef std::function<void(bool expired)> Task;
+
+    WorkerPool(unsigned threads, size_t max_queued);
+
+    // Waits for the tasks already running.
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    // Queue `task`; returns false, without calling it, if the queue is full.
+    bool submit(Task task, uint64_t deadline);
+
+    size_t queued() const;
+
+private:
+    struct Item
+    {
+        Task m_task;
+        uint64_t m_deadline;
+    };
+
+    void run();
+
+    const size_t m_max_queued;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<Item> m_queue;
+    bool m_shutdown{false};
+    std::vector<std::thread> m_threads;
+};
+
+}
+
+#endif
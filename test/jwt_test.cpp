@@ -0,0 +1,181 @@
+// Unit tests of the JWT pre-screen used before a token is handed to
+// scitokens-cpp.  Every implementation (scalar, SSE2, AVX2 where the CPU has
+// it) is compared against the byte-at-a-time loop it replaced: exhaustively
+// for every byte value at every position of short tokens, then on random
+// tokens of up to 20000 bytes, checking the reported spans as well as the
+// verdict.  DecodeJwtSpan is checked against an encoder on random data.
+//
+// Usage: scitokens-jwt-test [-f fuzz_tokens]
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "legacy.hh"
+#include "scitokens_jwt.hh"
+
+using scitokens_xrootd::JwtSpans;
+
+namespace {
+
+struct Scanner
+{
+    const char *m_name;
+    bool (*m_scan)(const char *, size_t, JwtSpans &);
+};
+
+std::vector<Scanner> scanners()
+{
+    std::vector<Scanner> result{{"scalar", scitokens_xrootd::ScanJwtScalar}};
+#ifdef SCITOKENS_JWT_X86
+    result.push_back({"sse2", scitokens_xrootd::ScanJwtSse2});
+    if (scitokens_xrootd::CpuHasAvx2()) {
+        result.push_back({"avx2", scitokens_xrootd::ScanJwtAvx2});
+    }
+#endif
+    result.push_back({"dispatch", scitokens_xrootd::ScanJwt});
+    return result;
+}
+
+const char g_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+std::string random_segment(size_t len, std::minstd_rand &rng)
+{
+    std::string result;
+    for (size_t idx = 0; idx < len; idx++) {
+        result += g_alphabet[rng() % 64];
+    }
+    return result;
+}
+
+// Unpadded base64url.
+std::string encode(const std::string &data)
+{
+    std::string result;
+    uint32_t bits = 0;
+    unsigned count = 0;
+    for (unsigned char byte : data) {
+        bits = (bits << 8) | byte;
+        count += 8;
+        while (count >= 6) {
+            count -= 6;
+            result += g_alphabet[(bits >> count) & 63];
+        }
+    }
+    if (count) {result += g_alphabet[(bits << (6 - count)) & 63];}
+    return result;
+}
+
+bool check(const Scanner &scanner, const std::string &token)
+{
+    JwtSpans spans;
+    bool expected = legacy::ScanJwt(token);
+    bool actual = scanner.m_scan(token.data(), token.size(), spans);
+    if (expected != actual) {
+        fprintf(stderr, "%s: %s for a %zu-byte token that should be %s\n", scanner.m_name,
+            actual ? "accepted" : "rejected", token.size(), expected ? "accepted" : "rejected");
+        return false;
+    }
+    if (!actual) {return true;}
+    auto first = token.find('.');
+    auto second = token.find('.', first + 1);
+    if (spans.m_header.m_offset != 0 || spans.m_header.m_length != first ||
+        spans.m_payload.m_offset != first + 1 || spans.m_payload.m_length != second - first - 1 ||
+        spans.m_signature.m_offset != second + 1 || spans.m_signature.m_length != token.size() - second - 1)
+    {
+        fprintf(stderr, "%s: wrong spans for a %zu-byte token\n", scanner.m_name, token.size());
+        return false;
+    }
+    return true;
+}
+
+}
+
+
+int main(int argc, char *argv[])
+{
+    size_t fuzz_tokens = 200000;
+    int opt;
+    while ((opt = getopt(argc, argv, "f:")) != -1) {
+        switch (opt) {
+        case 'f': fuzz_tokens = strtoull(optarg, nullptr, 10); break;
+        default:
+            fprintf(stderr, "Usage: %s [-f fuzz_tokens]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    auto all = scanners();
+    std::minstd_rand rng(42);
+    size_t checked = 0;
+
+    // Every byte value at every position, for lengths spanning a few SIMD
+    // blocks and their tails, with the separators in varying places.
+    for (size_t len = 0; len <= 80; len++) {
+        auto base = random_segment(len, rng);
+        if (len >= 3) {
+            base[rng() % len] = '.';
+            base[rng() % len] = '.';
+        }
+        for (size_t pos = 0; pos < len; pos++) {
+            for (unsigned value = 0; value < 256; value++) {
+                auto token = base;
+                token[pos] = static_cast<char>(value);
+                for (const auto &scanner : all) {
+                    if (!check(scanner, token)) {return 1;}
+                }
+                checked++;
+            }
+        }
+    }
+
+    // Random tokens: mostly well-formed, with a few stray bytes or extra
+    // separators in some of them.
+    for (size_t idx = 0; idx < fuzz_tokens; idx++) {
+        size_t len = rng() % (idx % 100 ? 600 : 20000);
+        auto token = random_segment(len, rng);
+        for (unsigned dots = rng() % 4; dots && len; dots--) {
+            token[rng() % len] = '.';
+        }
+        if (len && !(rng() % 4)) {
+            token[rng() % len] = static_cast<char>(rng() % 256);
+        }
+        for (const auto &scanner : all) {
+            if (!check(scanner, token)) {return 1;}
+        }
+        checked++;
+    }
+    printf("%zu tokens classified identically by", checked);
+    for (const auto &scanner : all) {printf(" %s", scanner.m_name);}
+    printf("\n");
+
+    std::string decoded;
+    for (size_t len = 0; len < 1000; len++) {
+        std::string data;
+        for (size_t idx = 0; idx < len; idx++) {data += static_cast<char>(rng());}
+        auto token = "." + encode(data) + ".";
+        scitokens_xrootd::JwtSpan span;
+        span.m_offset = 1;
+        span.m_length = token.size() - 2;
+        if (!scitokens_xrootd::DecodeJwtSpan(token.c_str(), span, decoded) || decoded != data) {
+            fprintf(stderr, "DecodeJwtSpan: wrong result for %zu bytes\n", len);
+            return 1;
+        }
+        // A single leftover character can never be a valid encoding.
+        if (span.m_length % 4 == 0) {
+            token.insert(1, "A");
+            span.m_length++;
+            if (scitokens_xrootd::DecodeJwtSpan(token.c_str(), span, decoded)) {
+                fprintf(stderr, "DecodeJwtSpan: accepted a truncated encoding\n");
+                return 1;
+            }
+        }
+    }
+    printf("1000 random payloads decoded correctly\n");
+    return 0;
+}
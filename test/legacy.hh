@@ -0,0 +1,75 @@
+#ifndef __SCITOKENS_LEGACY_HH
+#define __SCITOKENS_LEGACY_HH
+
+// Implementations that the plugin has since replaced with faster ones, kept
+// as the reference the unit tests check the replacements against and the
+// baseline the benchmarks time them against.
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace legacy {
+
+// The JWT pre-screen that GenerateAcls ran before handing a token to
+// scitokens-cpp, over an explicit length.
+inline bool ScanJwt(const std::string &token)
+{
+    bool looks_good = true;
+    int separator_count = 0;
+    for (auto cur_char : token) {
+        if (cur_char == '.') {
+            separator_count++;
+            if (separator_count > 2) {
+                break;
+            }
+        } else
+        if (!(cur_char >= 65 && cur_char <= 90) && // uppercase letters
+            !(cur_char >= 97 && cur_char <= 122) && // lowercase letters
+            !(cur_char >= 48 && cur_char <= 57) && // numbers
+            (cur_char != 43) && (cur_char != 47) && // + and /
+            (cur_char != 45) && (cur_char != 95)) // - and _
+        {
+            looks_good = false;
+            break;
+        }
+    }
+    return separator_count == 2 && looks_good;
+}
+
+// The previous implementation of MakeCanonical.
+inline bool MakeCanonical(const std::string &path, std::string &result)
+{
+    if (path.empty() || path[0] != '/') {return false;}
+
+    size_t pos = 0;
+    std::vector<std::string> components;
+    do {
+        while (path.size() > pos && path[pos] == '/') {pos++;}
+        auto next_pos = path.find_first_of("/", pos);
+        auto next_component = path.substr(pos, next_pos - pos);
+        pos = next_pos;
+        if (next_component.empty() || next_component == ".") {continue;}
+        else if (next_component == "..") {
+            if (!components.empty()) {
+                components.pop_back();
+            }
+        } else {
+            components.emplace_back(next_component);
+        }
+    } while (pos != std::string::npos);
+    if (components.empty()) {
+        result = "/";
+        return true;
+    }
+    std::stringstream ss;
+    for (const auto &comp : components) {
+        ss << "/" << comp;
+    }
+    result = ss.str();
+    return true;
+}
+
+}
+
+#endif
@@ -0,0 +1,104 @@
+// Unit tests of path canonicalization, which keeps a ".." in a request or a
+// token's scope from escaping the directory it names.  A few known cases are
+// checked first, then MakeCanonical and CanonicalRequestPath are compared
+// against the vector/stringstream implementation MakeCanonical replaced, on
+// random paths built from slashes, dots and short names.
+//
+// Usage: scitokens-path-test [-f fuzz_paths]
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <random>
+#include <string>
+
+#include "legacy.hh"
+#include "scitokens_path.hh"
+
+namespace {
+
+std::string random_path(std::minstd_rand &rng)
+{
+    static const char *pieces[] = {"/", "//", ".", "..", "a", "bc", ".x", "x.", "...", "d/", "\0"};
+    std::string path;
+    auto count = rng() % 12;
+    for (unsigned idx = 0; idx < count; idx++) {
+        auto piece = rng() % 11;
+        // The last piece is an embedded NUL, which both must treat as data.
+        path.append(pieces[piece], piece == 10 ? 1 : strlen(pieces[piece]));
+    }
+    return path;
+}
+
+bool check(const std::string &path, bool expected_ok, const std::string &expected)
+{
+    std::string actual;
+    bool actual_ok = scitokens_xrootd::MakeCanonical(path, actual);
+    if (expected_ok != actual_ok || (expected_ok && expected != actual)) {
+        fprintf(stderr, "Mismatch for \"%s\": expected \"%s\", got \"%s\"\n", path.c_str(),
+            expected_ok ? expected.c_str() : "(invalid)", actual_ok ? actual.c_str() : "(invalid)");
+        return false;
+    }
+    // Request paths are only canonicalized when they contain a dot
+    // component, but must always come out equivalent.
+    if (expected_ok && path.find('\0') == std::string::npos) {
+        std::string buffer, request;
+        scitokens_xrootd::MakeCanonical(scitokens_xrootd::CanonicalRequestPath(path.c_str(), buffer), request);
+        if (request != expected) {
+            fprintf(stderr, "CanonicalRequestPath(\"%s\") is equivalent to \"%s\", not \"%s\"\n", path.c_str(),
+                request.c_str(), expected.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+
+int main(int argc, char *argv[])
+{
+    size_t fuzz_paths = 1000000;
+    int opt;
+    while ((opt = getopt(argc, argv, "f:")) != -1) {
+        switch (opt) {
+        case 'f': fuzz_paths = strtoull(optarg, nullptr, 10); break;
+        default:
+            fprintf(stderr, "Usage: %s [-f fuzz_paths]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    const struct
+    {
+        const char *m_path;
+        const char *m_canonical;
+    } cases[] = {
+        {"/", "/"},
+        {"/..", "/"},
+        {"/../etc/passwd", "/etc/passwd"},
+        {"/store/user/../../etc", "/etc"},
+        {"/store/./user//alice/", "/store/user/alice"},
+        {"/store/user/alice/..", "/store/user"},
+        {"/store/...", "/store/..."},
+        {"/store/..x/.x", "/store/..x/.x"},
+        {"relative/path", nullptr},
+        {"", nullptr},
+    };
+    for (const auto &test : cases) {
+        if (!check(test.m_path, test.m_canonical != nullptr, test.m_canonical ? test.m_canonical : "")) {return 1;}
+    }
+    printf("%zu known paths canonicalized correctly\n", sizeof(cases) / sizeof(cases[0]));
+
+    std::minstd_rand rng(42);
+    std::string expected;
+    for (size_t idx = 0; idx < fuzz_paths; idx++) {
+        auto path = random_path(rng);
+        bool expected_ok = legacy::MakeCanonical(path, expected);
+        if (!check(path, expected_ok, expected)) {return 1;}
+    }
+    printf("%zu random paths canonicalized identically\n", fuzz_paths);
+    return 0;
+}
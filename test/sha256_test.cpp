@@ -0,0 +1,70 @@
+// Unit test of the SHA-256 that keys the token caches.  Saved and shared
+// caches are keyed by it too, so it is checked against OpenSSL's on the
+// standard test vectors and on random data of every length across several
+// blocks.
+//
+// Usage: scitokens-sha256-test
+
+#include <stdio.h>
+#include <string.h>
+
+#include <openssl/sha.h>
+
+#include <random>
+#include <string>
+
+#include "scitokens_sha256.hh"
+
+namespace {
+
+std::string hex(const unsigned char *digest)
+{
+    std::string result;
+    char byte[3];
+    for (unsigned idx = 0; idx < 32; idx++) {
+        snprintf(byte, sizeof(byte), "%02x", digest[idx]);
+        result += byte;
+    }
+    return result;
+}
+
+}
+
+
+int main()
+{
+    // FIPS 180-4 examples.
+    const struct
+    {
+        const char *m_message;
+        const char *m_digest;
+    } vectors[] = {
+        {"", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+        {"abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+        {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+         "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"},
+    };
+    unsigned char actual[32], expected[32];
+    for (const auto &vector : vectors) {
+        scitokens_xrootd::Sha256(vector.m_message, strlen(vector.m_message), actual);
+        if (hex(actual) != vector.m_digest) {
+            fprintf(stderr, "Wrong digest for \"%s\": %s\n", vector.m_message, hex(actual).c_str());
+            return 1;
+        }
+    }
+
+    std::minstd_rand rng(42);
+    std::string data;
+    for (size_t len = 0; len < 1200; len++) {
+        data.resize(len);
+        for (auto &byte : data) {byte = static_cast<char>(rng());}
+        scitokens_xrootd::Sha256(data.data(), len, actual);
+        SHA256(reinterpret_cast<const unsigned char *>(data.data()), len, expected);
+        if (memcmp(actual, expected, sizeof(actual))) {
+            fprintf(stderr, "Digest differs from OpenSSL for %zu bytes\n", len);
+            return 1;
+        }
+    }
+    printf("SHA-256 matches OpenSSL on 3 test vectors and 1200 random messages\n");
+    return 0;
+}